@@ -0,0 +1,669 @@
+﻿/*
+Copyright (c) 2025 Giuseppe Roberti.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// End-to-end benchmark of the find binary: generate synthetic trees of a
+// few shapes, run the same queries through find, GNU find and fd when they
+// are installed, and report wall time, entries/s, peak RSS and, for find,
+// the syscalls counted by --stats. Each run is a process of its own, which
+// is what makes peak RSS measurable and the tools comparable.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace fs = std::filesystem;
+
+#ifndef FIND_BINARY
+#define FIND_BINARY "./find"
+#endif
+
+// a synthetic tree, made of about `size` entries
+
+struct tree_shape {
+  enum kind : int {
+    wide,     // a single directory holding every file
+    deep,     // one long chain of directories with a file each
+    tiny,     // many small directories with a couple of files each
+    mixed,    // regular files of several extensions, symlinks and fifos
+    symlinks, // mostly symlinks, to files and to directories
+  } value;
+
+  tree_shape(kind v) : value{ v } {}
+
+  static auto from(std::string_view s) noexcept -> std::optional<tree_shape> {
+    for (auto k : { wide, deep, tiny, mixed, symlinks })
+      if (tree_shape{ k }.repr() == s)
+        return k;
+
+    return {};
+  }
+
+  auto repr() const noexcept -> std::string_view {
+    switch (value) {
+
+    case wide: return "wide";
+    case deep: return "deep";
+    case tiny: return "tiny";
+    case mixed: return "mixed";
+    case symlinks: return "symlinks";
+
+    }
+    return "<unknown>";
+  }
+};
+
+struct generator {
+
+public:
+
+  generator(fs::path root, std::size_t size) : m_root{ std::move(root) }, m_size{ size } {}
+
+  // build the tree unless a complete one is there already
+
+  auto make(tree_shape shape) -> bool {
+    auto marker = m_root / ".complete";
+
+    if (fs::exists(marker))
+      return true;
+
+    auto ec = std::error_code{};
+
+    fs::remove_all(m_root, ec);
+
+    if (!mkdir(m_root.native()))
+      return false;
+
+    m_count = 0;
+
+    switch (shape.value) {
+
+    case tree_shape::wide:
+      files(m_root.native(), m_size, false);
+
+      break;
+
+    case tree_shape::deep:
+      chain(m_root.native(), std::min<std::size_t>(m_size / 2, max_depth));
+
+      break;
+
+    case tree_shape::tiny:
+      fanout(m_root.native(), 8, 2, false);
+
+      break;
+
+    case tree_shape::mixed:
+      fanout(m_root.native(), 16, 32, true);
+
+      break;
+
+    case tree_shape::symlinks:
+      links(m_root.native());
+
+      break;
+    }
+
+    return touch(marker.native());
+  }
+
+private:
+
+  // keeps the paths of the deep shape below PATH_MAX, for the other tools
+
+  static constexpr std::size_t max_depth = 1000;
+
+  static constexpr std::string_view extensions[] = { ".c", ".h", ".o", ".log", ".txt", ".tmp", ".json", "" };
+
+  auto left() const noexcept -> bool { return m_count < m_size; }
+
+  auto mkdir(const std::string& path) -> bool { ++m_count; return ::mkdir(path.c_str(), 0755) == 0 || errno == EEXIST; }
+
+  auto touch(const std::string& path) -> bool {
+    ++m_count;
+
+    auto fd = ::open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+
+    return fd >= 0 && ::close(fd) == 0;
+  }
+
+  void files(const std::string& dir, std::size_t n, bool special) {
+    for (std::size_t i = 0; i < n && left(); ++i) {
+      auto path = std::format("{}/file{}{}", dir, i, extensions[i % std::size(extensions)]);
+
+      if (special && i % 13 == 0) {
+        ++m_count;
+
+        ::mkfifo(path.c_str(), 0644);
+      }
+      else if (special && i % 7 == 0) {
+        ++m_count;
+
+        ::symlink("file0.c", path.c_str());
+      }
+      else {
+        touch(path);
+      }
+    }
+  }
+
+  void chain(std::string dir, std::size_t depth) {
+    for (std::size_t i = 0; i < depth && left(); ++i) {
+      touch(dir + "/f.txt");
+
+      dir += "/d";
+
+      mkdir(dir);
+    }
+  }
+
+  // breadth-first, so that the budget of entries spreads evenly
+
+  void fanout(const std::string& root, std::size_t dirs, std::size_t n, bool special) {
+    auto level = std::vector<std::string>{ root };
+
+    while (left() && !level.empty()) {
+      auto next = std::vector<std::string>{};
+
+      for (auto& dir : level) {
+        files(dir, n, special);
+
+        for (std::size_t i = 0; i < dirs && left(); ++i) {
+          next.push_back(std::format("{}/dir{}", dir, i));
+
+          mkdir(next.back());
+        }
+      }
+
+      level = std::move(next);
+    }
+  }
+
+  void links(const std::string& root) {
+    auto n = std::max<std::size_t>(m_size / 64, 1);
+
+    for (std::size_t d = 0; d < n && left(); ++d) {
+      auto dir = std::format("{}/dir{}", root, d);
+
+      mkdir(dir);
+
+      touch(dir + "/target");
+
+      for (std::size_t i = 0; i < 60 && left(); ++i) {
+        ++m_count;
+
+        auto to = i % 3 == 0 ? std::format("../dir{}", (d + 1) % n) : std::string{ "target" };
+
+        ::symlink(to.c_str(), std::format("{}/link{}", dir, i).c_str());
+      }
+    }
+  }
+
+  fs::path m_root;
+
+  std::size_t m_size;
+
+  std::size_t m_count = 0;
+};
+
+// what one run of a tool cost, as seen from the parent
+
+struct sample {
+  double wall_ms = 0;
+  std::size_t lines = 0;
+  long max_rss_kb = 0;
+  std::optional<std::uint64_t> syscalls;
+  bool ok = false;
+};
+
+struct runner {
+
+public:
+
+  // run argv with stdout counted line by line and stderr kept, which is
+  // where find reports its --stats
+
+  static auto run(const std::vector<std::string>& args) -> sample {
+    auto res = sample{};
+
+    int out[2], err[2];
+
+    if (::pipe(out) != 0 || ::pipe(err) != 0)
+      return res;
+
+    auto actions = posix_spawn_file_actions_t{};
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+    posix_spawn_file_actions_addclose(&actions, out[0]);
+    posix_spawn_file_actions_addclose(&actions, err[0]);
+
+    auto argv = std::vector<char*>{};
+
+    for (auto& a : args)
+      argv.push_back(const_cast<char*>(a.c_str()));
+
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto pid = pid_t{};
+
+    auto spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ) == 0;
+
+    posix_spawn_file_actions_destroy(&actions);
+
+    ::close(out[1]);
+    ::close(err[1]);
+
+    auto diag = std::string{};
+
+    if (spawned) {
+      res.lines = drain(out[0], err[0], diag);
+
+      int status = 0;
+
+      auto usage = rusage{};
+
+      ::wait4(pid, &status, 0, &usage);
+
+      res.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      res.max_rss_kb = usage.ru_maxrss;
+      res.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+      res.syscalls = syscalls_of(diag);
+    }
+
+    ::close(out[0]);
+    ::close(err[0]);
+
+    return res;
+  }
+
+private:
+
+  static auto drain(int out, int err, std::string& diag) -> std::size_t {
+    auto lines = std::size_t{ 0 };
+
+    char buf[64 * 1024];
+
+    // stderr stays small, read it once stdout is done
+
+    for (ssize_t n; (n = ::read(out, buf, sizeof(buf))) > 0;)
+      lines += std::count(buf, buf + n, '\n');
+
+    for (ssize_t n; (n = ::read(err, buf, sizeof(buf))) > 0;)
+      diag.append(buf, static_cast<std::size_t>(n));
+
+    return lines;
+  }
+
+  static auto counter(std::string_view json, std::string_view key) -> std::optional<std::uint64_t> {
+    auto k = std::format("\"{}\":", key);
+
+    auto at = json.find(k);
+
+    if (at == std::string_view::npos)
+      return {};
+
+    auto v = std::uint64_t{};
+
+    auto* p = json.data() + at + k.size();
+
+    if (std::from_chars(p, json.data() + json.size(), v).ec != std::errc{})
+      return {};
+
+    return v;
+  }
+
+  static auto syscalls_of(std::string_view json) -> std::optional<std::uint64_t> {
+    auto total = std::uint64_t{ 0 };
+
+    for (auto key : { "dirs_opened", "getdents_calls", "stat_calls", "writes" }) {
+      auto v = counter(json, key);
+
+      if (!v)
+        return {};
+
+      total += *v;
+    }
+
+    return total;
+  }
+};
+
+struct bench {
+
+public:
+
+  struct options {
+    fs::path root;
+    std::vector<tree_shape> shapes;
+    std::size_t size = 200'000;
+    std::size_t runs = 5;
+    std::string threads;
+    bool cold = false;
+    bool keep = false;
+  };
+
+  static auto parse(int argc, const char** argv) -> std::optional<options> {
+    auto obj = options{};
+
+    obj.root = fs::exists("/dev/shm") ? fs::path{ "/dev/shm" } : fs::temp_directory_path();
+
+    for (int i = 1; i < argc; ++i) {
+      auto arg = std::string_view{ argv[i] };
+
+      auto value = [&]() -> std::optional<std::string_view> {
+        if (i + 1 >= argc)
+          return {};
+
+        return argv[++i];
+      };
+
+      auto number = [&](std::size_t& n) {
+        auto v = value();
+
+        return v && std::from_chars(v->data(), v->data() + v->size(), n).ec == std::errc{} && n > 0;
+      };
+
+      if (arg == "--root") {
+        auto v = value();
+
+        if (!v)
+          return {};
+
+        obj.root = *v;
+      }
+      else if (arg == "--shape") {
+        auto v = value();
+
+        if (!v)
+          return {};
+
+        if (*v == "all")
+          continue;
+
+        auto shape = tree_shape::from(*v);
+
+        if (!shape)
+          return {};
+
+        obj.shapes.push_back(*shape);
+      }
+      else if (arg == "--size") {
+        if (!number(obj.size))
+          return {};
+      }
+      else if (arg == "--runs") {
+        if (!number(obj.runs))
+          return {};
+      }
+      else if (arg == "-j") {
+        auto v = value();
+
+        if (!v)
+          return {};
+
+        obj.threads = *v;
+      }
+      else if (arg == "--cold") {
+        obj.cold = true;
+      }
+      else if (arg == "--keep") {
+        obj.keep = true;
+      }
+      else {
+        return {};
+      }
+    }
+
+    if (obj.shapes.empty())
+      obj.shapes = { tree_shape::wide, tree_shape::deep, tree_shape::tiny, tree_shape::mixed, tree_shape::symlinks };
+
+    return obj;
+  }
+
+  explicit bench(options opts) : m_opts{ std::move(opts) } {}
+
+  auto run() -> int {
+    auto failed = false;
+
+    if (m_opts.cold && !drop_caches())
+      std::cerr << "warning: cannot drop the page cache (not root?), cold runs are warm\n";
+
+    std::cout << std::format("{:<9} {:<7} {:<8} {:>10} {:>10} {:>12} {:>10} {:>10}\n",
+      "shape", "query", "tool", "listed", "median ms", "entries/s", "max RSS kB", "syscalls");
+
+    for (auto shape : m_opts.shapes) {
+      auto dir = m_opts.root / std::format("find-bench-{}-{}", shape.repr(), m_opts.size);
+
+      if (!generate(dir, shape)) {
+        std::cerr << std::format("error: cannot generate {}\n", dir.native());
+
+        return EXIT_FAILURE;
+      }
+
+      for (auto& q : queries)
+        failed |= !measure(shape, q, dir.native());
+
+      if (!m_opts.keep) {
+        auto ec = std::error_code{};
+
+        fs::remove_all(dir, ec);
+      }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+private:
+
+  struct query {
+    std::string_view name;
+    std::vector<std::string> find_args;
+    std::vector<std::string> fd_args;
+  };
+
+  inline static const query queries[] = {
+    { "all", {}, { "." } },
+    { "name", { "-name", "*.log" }, { "-g", "*.log" } },
+    { "type", { "-type", "f" }, { "-t", "f", "." } },
+  };
+
+  static auto drop_caches() -> bool {
+    ::sync();
+
+    auto fd = ::open("/proc/sys/vm/drop_caches", O_WRONLY | O_CLOEXEC);
+
+    if (fd < 0)
+      return false;
+
+    auto ok = ::write(fd, "3", 1) == 1;
+
+    ::close(fd);
+
+    return ok;
+  }
+
+  // in a child of its own: the rusage of a spawned run includes the peak
+  // of the image it was exec'd from, which the generator would inflate
+
+  auto generate(const fs::path& dir, tree_shape shape) -> bool {
+    auto pid = ::fork();
+
+    if (pid == 0)
+      ::_exit(generator{ dir, m_opts.size }.make(shape) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    int status = 0;
+
+    return pid > 0 && ::waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  static auto have(std::string_view tool) -> bool {
+    auto* path = std::getenv("PATH");
+
+    if (!path)
+      return false;
+
+    for (auto dirs = std::string_view{ path }; !dirs.empty();) {
+      auto dir = dirs.substr(0, dirs.find(':'));
+
+      dirs.remove_prefix(std::min(dirs.size(), dir.size() + 1));
+
+      if (::access((fs::path{ dir } / tool).c_str(), X_OK) == 0)
+        return true;
+    }
+
+    return false;
+  }
+
+  // the median of some runs, after one to warm the cache up unless cold
+
+  auto sampled(const std::vector<std::string>& args) -> sample {
+    if (!m_opts.cold)
+      runner::run(args);
+
+    auto samples = std::vector<sample>{};
+
+    for (std::size_t i = 0; i < m_opts.runs; ++i) {
+      if (m_opts.cold)
+        drop_caches();
+
+      samples.push_back(runner::run(args));
+    }
+
+    std::ranges::sort(samples, {}, &sample::wall_ms);
+
+    auto res = samples[samples.size() / 2];
+
+    res.ok = std::ranges::all_of(samples, &sample::ok);
+
+    return res;
+  }
+
+  void print(tree_shape shape, std::string_view q, std::string_view tool, const sample& s) {
+    // every query walks the whole tree, whatever it lists
+
+    auto rate = s.wall_ms > 0 ? static_cast<double>(m_walked) / (s.wall_ms / 1000) : 0;
+
+    std::cout << std::format("{:<9} {:<7} {:<8} {:>10} {:>10.2f} {:>12.0f} {:>10} {:>10}\n",
+      shape.repr(), q, tool, s.lines, s.wall_ms, rate, s.max_rss_kb,
+      s.syscalls ? std::to_string(*s.syscalls) : std::string{ "-" });
+  }
+
+  // find against the others; a different count than GNU find is a failure
+
+  auto measure(tree_shape shape, const query& q, const std::string& dir) -> bool {
+    auto args = std::vector<std::string>{ FIND_BINARY, dir };
+
+    args.insert(args.end(), q.find_args.begin(), q.find_args.end());
+
+    if (!m_opts.threads.empty())
+      args.insert(args.end(), { "-j", m_opts.threads });
+
+    args.push_back("--stats=json");
+
+    auto ours = sampled(args);
+
+    if (q.find_args.empty())
+      m_walked = ours.lines;
+
+    print(shape, q.name, "find", ours);
+
+    auto ok = ours.ok;
+
+    if (have("find")) {
+      auto gnu = std::vector<std::string>{ "find", dir };
+
+      gnu.insert(gnu.end(), q.find_args.begin(), q.find_args.end());
+
+      auto theirs = sampled(gnu);
+
+      print(shape, q.name, "gnu", theirs);
+
+      if (theirs.ok && theirs.lines != ours.lines) {
+        std::cerr << std::format("error: {} {}: find listed {} entries, GNU find {}\n", shape.repr(), q.name, ours.lines, theirs.lines);
+
+        ok = false;
+      }
+    }
+
+    for (auto tool : { "fd", "fdfind" })
+      if (have(tool)) {
+        auto fd = std::vector<std::string>{ tool, "--unrestricted", "--no-ignore" };
+
+        fd.insert(fd.end(), q.fd_args.begin(), q.fd_args.end());
+
+        fd.push_back(dir);
+
+        print(shape, q.name, "fd", sampled(fd));
+
+        break;
+      }
+
+    return ok;
+  }
+
+  options m_opts;
+
+  std::size_t m_walked = 0;
+};
+
+int main(const int argc, const char** argv) {
+  auto opts = bench::parse(argc, argv);
+
+  if (!opts) {
+    std::cerr
+      << "usage: find_bench [--root DIR] [--shape wide|deep|tiny|mixed|symlinks|all]...\n"
+      << "                  [--size ENTRIES] [--runs N] [-j THREADS] [--cold] [--keep]\n";
+
+    return EXIT_FAILURE;
+  }
+
+  return bench{ std::move(*opts) }.run();
+}
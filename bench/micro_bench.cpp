@@ -0,0 +1,306 @@
+﻿/*
+Copyright (c) 2025 Giuseppe Roberti.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Per-entry cost of the filters, away from any I/O: a fixed corpus of
+// filenames, as found in source trees and home directories, goes through
+// the compiled -name/-iname globs, the std::regex translation find used
+// before them, the substring search the contains shape relies on and
+// finder::shall_print as parsed from real arguments. Every benchmark
+// reports the time per entry.
+
+#include "../find.hpp"
+
+#include <regex>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+using namespace libfind::detail;
+
+constexpr std::string_view corpus_files[] = {
+  "main.c", "main.cpp", "find.cpp", "find.hpp", "util.h", "util.c", "Makefile", "CMakeLists.txt",
+  "README.md", "README", "LICENSE", "LICENSE.txt", "CHANGELOG.md", ".gitignore", ".gitattributes",
+  ".editorconfig", ".clang-format", "configure", "configure.ac", "config.h.in", "config.status",
+  "libfoo.so", "libfoo.so.1", "libfoo.so.1.2.3", "libbar.a", "libz.so.1.2.13", "ld-linux-x86-64.so.2",
+  "parser.o", "lexer.o", "parser.tab.c", "lexer.yy.c", "test_parser.cpp", "test_lexer.cpp",
+  "parser_test.go", "server.go", "go.mod", "go.sum", "Cargo.toml", "Cargo.lock", "lib.rs", "mod.rs",
+  "index.js", "index.ts", "index.d.ts", "package.json", "package-lock.json", "yarn.lock", "tsconfig.json",
+  "webpack.config.js", "App.tsx", "App.test.tsx", "styles.css", "styles.min.css", "bundle.min.js",
+  "bundle.min.js.map", "favicon.ico", "logo.png", "logo@2x.png", "IMG_20240611_183012.jpg",
+  "IMG_20240612_090455.JPG", "DSC00042.ARW", "Screenshot from 2024-03-01 10-22-31.png", "photo.heic",
+  "video.mp4", "song.mp3", "podcast episode 12.m4a", "report.pdf", "Report-Final (2).pdf",
+  "invoice_2024_03.pdf", "notes.txt", "todo.txt", "draft.docx", "budget.xlsx", "slides.pptx",
+  "archive.tar.gz", "backup-2024-06-01.tar.zst", "dump.sql", "data.csv", "data.parquet", "model.onnx",
+  "weights.bin", "syslog", "syslog.1", "syslog.2.gz", "kern.log", "auth.log", "auth.log.1", "dpkg.log",
+  "Xorg.0.log", "error.log", "access.log.2024-06-01", "core", "core.12345", "a.out", "nohup.out",
+  "__init__.py", "setup.py", "pyproject.toml", "requirements.txt", "manage.py", "views.py",
+  "models.cpython-311.pyc", "test_models.py", "conftest.py", "Dockerfile", "docker-compose.yml",
+  ".env", ".env.local", "id_rsa", "id_rsa.pub", "known_hosts", "authorized_keys", ".bashrc",
+  ".profile", ".vimrc", ".viminfo", "init.lua", "settings.json", "keybindings.json", "user-dirs.dirs",
+  "mimeapps.list", "fonts.conf", "DejaVuSans.ttf", "NotoColorEmoji.ttf", "en_US.UTF-8", "locale.alias",
+  "passwd", "group", "shadow", "hosts", "resolv.conf", "fstab", "os-release", "ld.so.cache",
+  "vmlinuz-6.1.0-21-amd64", "initrd.img-6.1.0-21-amd64", "System.map-6.1.0-21-amd64",
+  "ext4.ko.xz", "nvidia.ko", "libstdc++.so.6.0.30", "libc.so.6", "python3.11", "bash", "ls", "grep",
+  "ИНСТРУКЦИЯ.txt", "résumé.pdf", "日本語のファイル名.txt", "verylongfilename_with_many_parts_and_numbers_0123456789.tmp",
+  "00000000000000000000000000000000.lock", "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08",
+  "file.txt~", "#file.txt#", ".file.txt.swp", "Thumbs.db", ".DS_Store", "desktop.ini",
+};
+
+constexpr std::string_view corpus_dirs[] = {
+  "src", "include", "lib", "bin", "build", "tests", "test", "docs", "node_modules", ".git", ".cache",
+  "__pycache__", "vendor", "third_party", "target", "debug", "release", "Downloads", "Documents",
+  "Pictures", "Music", "Videos", ".config", ".local", "share", "usr", "etc", "var", "log", "tmp",
+};
+
+// the corpus as the predicates see it: names with the type the listing
+// would have told
+
+struct corpus {
+
+public:
+
+  static auto get() -> const corpus& {
+    static const auto obj = corpus{};
+
+    return obj;
+  }
+
+  std::vector<std::string_view> names;
+
+  std::vector<dir_entry> entries;
+
+private:
+
+  corpus() {
+    for (auto n : corpus_files)
+      add(n, fs::file_type::regular);
+
+    for (auto n : corpus_dirs)
+      add(n, fs::file_type::directory);
+  }
+
+  void add(std::string_view name, fs::file_type type) {
+    names.push_back(name);
+
+    m_paths.emplace_back(name);
+
+#if defined(__linux__)
+    entries.emplace_back("/bench", name, -1, m_paths.back().c_str(), type, meta_need::type);
+#else
+    m_dir_entries.emplace_back(fs::path{ "/bench" } / m_paths.back());
+    entries.emplace_back("/bench", name, m_dir_entries.back(), meta_need::type);
+
+    (void)type;
+#endif
+  }
+
+  std::deque<std::string> m_paths;
+
+#if !defined(__linux__)
+  std::deque<fs::directory_entry> m_dir_entries;
+#endif
+};
+
+void per_entry(benchmark::State& state, std::size_t n) {
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * n));
+
+  // seconds per entry, printed with its SI prefix
+
+  state.counters["per_entry"] = benchmark::Counter(
+    static_cast<double>(n),
+    benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+// -name and -iname patterns of each shape the glob compiles to
+
+constexpr const char* patterns[] = {
+  "Makefile",     // exact
+  "lib*",         // prefix
+  "*.log",        // suffix
+  "*test*",       // contains
+  "*.tar.*",      // contains, two bytes longer
+  "*.[ch]",       // general, a set
+  "IMG_*_??????.jpg", // general, stars and anys
+};
+
+void glob_match(benchmark::State& state, bool icase) {
+  auto pattern = patterns[state.range(0)];
+
+  auto g = glob::compile(pattern, icase);
+
+  auto& c = corpus::get();
+
+  state.SetLabel(pattern);
+
+  for (auto _ : state)
+    for (auto name : c.names)
+      benchmark::DoNotOptimize(g.match(name));
+
+  per_entry(state, c.names.size());
+}
+
+// the matcher -name used to be: every `*` turned into `.*`
+
+void regex_match(benchmark::State& state, bool icase) {
+  auto pattern = std::string{ patterns[state.range(0)] };
+
+  for (std::size_t at = 0; (at = pattern.find('*', at)) != std::string::npos; at += 2)
+    pattern.replace(at, 1, ".*");
+
+  auto re = std::regex{ pattern, icase ? std::regex_constants::ECMAScript | std::regex_constants::icase : std::regex_constants::ECMAScript };
+
+  auto& c = corpus::get();
+
+  state.SetLabel(patterns[state.range(0)]);
+
+  for (auto _ : state)
+    for (auto name : c.names)
+      benchmark::DoNotOptimize(std::regex_match(name.begin(), name.end(), re));
+
+  per_entry(state, c.names.size());
+}
+
+void BM_glob_name(benchmark::State& state) { glob_match(state, false); }
+void BM_glob_iname(benchmark::State& state) { glob_match(state, true); }
+void BM_regex_name(benchmark::State& state) { regex_match(state, false); }
+void BM_regex_iname(benchmark::State& state) { regex_match(state, true); }
+
+BENCHMARK(BM_glob_name)->DenseRange(0, std::size(patterns) - 1);
+BENCHMARK(BM_glob_iname)->DenseRange(0, std::size(patterns) - 1);
+BENCHMARK(BM_regex_name)->DenseRange(0, std::size(patterns) - 1);
+BENCHMARK(BM_regex_iname)->DenseRange(0, std::size(patterns) - 1);
+
+// the search behind the contains shape, against the library's
+
+void BM_simd_contains(benchmark::State& state) {
+  auto& c = corpus::get();
+
+  auto icase = state.range(0) != 0;
+
+  for (auto _ : state)
+    for (auto name : c.names)
+      benchmark::DoNotOptimize(simd::contains(name, "test", icase));
+
+  per_entry(state, c.names.size());
+}
+
+void BM_std_contains(benchmark::State& state) {
+  auto& c = corpus::get();
+
+  for (auto _ : state)
+    for (auto name : c.names)
+      benchmark::DoNotOptimize(name.find("test") != std::string_view::npos);
+
+  per_entry(state, c.names.size());
+}
+
+BENCHMARK(BM_simd_contains)->Arg(0)->Arg(1);
+BENCHMARK(BM_std_contains);
+
+// the whole predicate chain, with the arguments given on the command line
+
+constexpr std::string_view extensions[] = { "tmp", "swp", "bak", "o", "obj", "pyc", "log", "orig" };
+
+const std::vector<std::vector<const char*>> predicates = {
+  { "find", "/bench" },
+  { "find", "/bench", "-type", "f" },
+  { "find", "/bench", "-type", "d" },
+  { "find", "/bench", "-name", "*.log" },
+  { "find", "/bench", "-iname", "*.JPG" },
+  { "find", "/bench", "-type", "f", "-name", "*.[ch]" },
+  { "find", "/bench", "-type", "f", "-name", "*test*", "-iname", "*.PY" },
+  { "find", "/bench", "(", "-name", "*.o", "-o", "-name", "*.a", ")", "-not", "-path", "*/vendor/*" },
+  { "find", "/bench", "-type", "d", "-o", "-name", "*.log", "-o", "-iname", "*.jpg" },
+};
+
+void BM_shall_print(benchmark::State& state) {
+  auto& args = predicates[state.range(0)];
+
+  auto f = finder::from({ static_cast<int>(args.size()), const_cast<const char**>(args.data()) });
+
+  if (!f) {
+    state.SkipWithError("invalid arguments");
+
+    return;
+  }
+
+  auto label = std::string{};
+
+  for (std::size_t i = 2; i < args.size(); ++i)
+    label += std::format("{}{}", i > 2 ? " " : "", args[i]);
+
+  state.SetLabel(label);
+
+  auto& c = corpus::get();
+
+  for (auto _ : state)
+    for (auto& entry : c.entries)
+      benchmark::DoNotOptimize(f->shall_print(entry));
+
+  per_entry(state, c.entries.size());
+}
+
+BENCHMARK(BM_shall_print)->DenseRange(0, static_cast<std::int64_t>(predicates.size()) - 1);
+
+// -name '*.ext0' -o -name '*.ext1' -o ..., which should cost about the
+// same for any number of extensions
+
+void BM_shall_print_extensions(benchmark::State& state) {
+  auto patterns = std::deque<std::string>{};
+
+  auto args = std::vector<const char*>{ "find", "/bench" };
+
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    if (i > 0)
+      args.push_back("-o");
+
+    patterns.push_back(std::format("*.{}{}", extensions[i % std::size(extensions)], i / std::size(extensions)));
+
+    args.push_back("-name");
+    args.push_back(patterns.back().c_str());
+  }
+
+  auto f = finder::from({ static_cast<int>(args.size()), args.data() });
+
+  auto& c = corpus::get();
+
+  for (auto _ : state)
+    for (auto& entry : c.entries)
+      benchmark::DoNotOptimize(f->shall_print(entry));
+
+  per_entry(state, c.entries.size());
+}
+
+BENCHMARK(BM_shall_print_extensions)->RangeMultiplier(2)->Range(1, 64);
+
+}
+
+BENCHMARK_MAIN();
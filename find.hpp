@@ -0,0 +1,7172 @@
+﻿/*
+Copyright (c) 2025 Giuseppe Roberti.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <expected>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <set>
+#include <shared_mutex>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(_WIN32)
+#include <cstdio>
+#else
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <spawn.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// spawned commands inherit it; <unistd.h> only declares it with
+// _GNU_SOURCE on glibc, not at all on macOS
+
+extern char** environ;
+#endif
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// the io_uring backend needs the headers of Linux 5.6 at least, for
+// IORING_OP_OPENAT and IORING_OP_STATX: those came along with
+// IORING_FEAT_CUR_PERSONALITY, it is left out with older ones
+
+#if defined(IORING_FEAT_SINGLE_MMAP) && defined(IORING_FEAT_CUR_PERSONALITY) && defined(__NR_io_uring_setup)
+#define FIND_IO_URING 1
+#endif
+
+// all of find is kept out of the way of what includes it, libfind.hpp
+// exports what a program embedding the walk uses
+
+namespace libfind::detail {
+
+namespace fs = std::filesystem;
+
+template<typename... Args>
+void err(std::format_string<Args...> fmt, Args&&... args) {
+  std::cerr
+    << "ERROR: "
+    << std::format(fmt, std::forward<Args>(args)...)
+    << std::endl;
+}
+
+struct error_code {
+  enum kind : int {
+
+    duplicate_arg = 1,
+    unknown_arg,
+    generic,
+
+    path_absent,
+    path_not_exist,
+    path_not_dir,
+
+    invalid_arg,
+
+    write_failed,
+
+    invalid_expr,
+
+    index_failed,
+
+    exec_failed,
+    delete_failed,
+
+  } m_code;
+
+  std::optional<std::string> m_msg;
+
+  error_code(auto c, auto m = {})
+    : m_code{ c }, m_msg{ m }
+  {
+  }
+
+  auto message() const
+    -> std::string
+  {
+    return m_msg.value_or(default_msg());
+  }
+
+  auto value() const
+    -> int
+  {
+    return m_code;
+  }
+
+  auto handle_err() const
+    -> std::expected<void, int>
+  {
+    err("{}", message().c_str());
+
+    return std::unexpected{ value() };
+  }
+
+private:
+  std::string default_msg() const {
+    switch (m_code) {
+
+    case error_code::duplicate_arg: return "Use one modifier at most one time!";
+    case error_code::unknown_arg: return "Unknown modifier!";
+    case error_code::generic: return "Generic error";
+
+    case error_code::path_absent: return "Please specify a directory to proceed!";
+    case error_code::path_not_exist: return "The path is not accessible or does not exists!";
+    case error_code::path_not_dir: return "The path is not a directory!";
+
+    case error_code::invalid_arg: return "Invalid modifier value!";
+
+    case error_code::write_failed: return "Unable to write the output!";
+
+    case error_code::invalid_expr: return "Invalid expression!";
+
+    case error_code::index_failed: return "Unable to write the index!";
+
+    case error_code::exec_failed: return "A command could not be run or failed!";
+    case error_code::delete_failed: return "Unable to delete some of the entries!";
+
+    }
+    return "<unspecified error message>";
+  }
+};
+
+static inline auto make_unexpected(error_code::kind c, std::optional<std::string> m = {}) {
+  return std::unexpected{ error_code{ c, m } };
+}
+
+struct opts {
+
+public:
+
+  using size_type = std::size_t;
+
+  using arg_type = std::string_view;
+
+  struct iterator {
+
+  private:
+    const char** data;
+
+  public:
+    iterator(const char** data) : data{ data } {}
+
+    inline bool operator==(iterator& o) { return data == o.data; }
+
+    inline iterator& operator++() { ++data; return *this; }
+
+    inline arg_type operator* () { return *data; }
+  };
+
+  opts(const int argc, const char** argv) noexcept
+    : n{ static_cast<size_type>(argc) }
+    , vs{ argv }
+  {
+  }
+
+  inline arg_type at(size_type n) const noexcept { return vs[n]; }
+
+  inline size_type size() const noexcept { return n; }
+
+  iterator begin() const { return &vs[0]; }
+
+  iterator it(std::size_t i) const { return &vs[i]; }
+
+  iterator end() const { return &vs[n]; }
+
+private:
+
+  const std::size_t n;
+
+  const char** vs;
+};
+
+// cheap event counters for --stats: every thread bumps its own slot with
+// plain relaxed stores and anybody may read them at any time. Slots are
+// never given back, so the totals include threads that are gone already.
+
+struct stats {
+
+public:
+
+  enum counter : std::size_t {
+    allocs,
+    alloc_bytes,
+    dirs_opened,
+    getdents_calls,
+    stat_calls,
+    entries,
+    matches,
+    writes,
+    commands,
+    deleted,
+    syscall_ns,
+
+    counter_count
+  };
+
+  using values = std::array<std::uint64_t, counter_count>;
+
+  static inline void add(counter c, std::uint64_t n = 1) noexcept {
+    if (!t_slot)
+      claim();
+
+    auto& v = t_slot->v[c];
+
+    if (t_shared)
+      v.fetch_add(n, std::memory_order_relaxed);
+    else
+      v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  // the time spent in the system calls of the walk goes to syscall_ns only
+  // once asked for, it costs two clock reads each
+
+  static inline void time_syscalls(bool on) noexcept { s_timing.store(on, std::memory_order_relaxed); }
+
+  static inline auto timed(auto&& fn) noexcept {
+    if (!s_timing.load(std::memory_order_relaxed))
+      return fn();
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto res = fn();
+
+    add(syscall_ns, static_cast<std::uint64_t>(std::chrono::nanoseconds{ std::chrono::steady_clock::now() - start }.count()));
+
+    return res;
+  }
+
+  static auto total() noexcept -> values {
+    auto res = values{};
+
+    auto n = std::min(s_used.load(std::memory_order_acquire), max_slots);
+
+    for (std::size_t i = 0; i <= n; ++i)
+      for (std::size_t c = 0; c < counter_count; ++c)
+        res[c] += s_slots[i].v[c].load(std::memory_order_relaxed);
+
+    return res;
+  }
+
+  static auto name(counter c) noexcept -> std::string_view {
+    switch (c) {
+
+    case allocs: return "allocs";
+    case alloc_bytes: return "alloc_bytes";
+    case dirs_opened: return "dirs_opened";
+    case getdents_calls: return "getdents_calls";
+    case stat_calls: return "stat_calls";
+    case entries: return "entries";
+    case matches: return "matches";
+    case writes: return "writes";
+    case commands: return "commands";
+    case deleted: return "deleted";
+    case syscall_ns: return "syscall_ns";
+    case counter_count: break;
+
+    }
+    return "<unknown>";
+  }
+
+private:
+
+  struct alignas(64) slot {
+    std::array<std::atomic<std::uint64_t>, counter_count> v;
+  };
+
+  // threads past max_slots share the last slot, with atomic increments
+
+  static constexpr std::size_t max_slots = 256;
+
+  static void claim() noexcept {
+    auto i = s_used.fetch_add(1, std::memory_order_acq_rel);
+
+    t_shared = i >= max_slots;
+    t_slot = &s_slots[std::min(i, max_slots)];
+  }
+
+  static inline std::array<slot, max_slots + 1> s_slots;
+
+  static inline std::atomic<std::size_t> s_used{ 0 };
+
+  static inline std::atomic<bool> s_timing{ false };
+
+  static inline thread_local slot* t_slot = nullptr;
+
+  static inline thread_local bool t_shared = false;
+};
+
+template<typename Job>
+struct work_pool {
+
+public:
+
+  using size_type = std::size_t;
+
+  explicit work_pool(size_type n) noexcept
+    : m_workers(std::max<size_type>(n, 1))
+    , m_allowed{ m_workers.size() }
+  {
+  }
+
+  static auto default_size() noexcept -> size_type {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  inline size_type size() const noexcept { return m_workers.size(); }
+
+  // index of the calling worker, only meaningful from within run()
+
+  inline size_type index() const noexcept { return t_pool == this ? t_index : 0; }
+
+  // the most jobs ever queued at once
+
+  inline size_type high_water() const noexcept { return m_high.load(std::memory_order_relaxed); }
+
+  inline size_type queued() const noexcept { return m_queued.load(std::memory_order_relaxed); }
+
+  // how many workers are running a job or looking for one right now
+
+  inline size_type active() const noexcept {
+    return size() - std::min(size(), m_sleeping.load(std::memory_order_relaxed) + m_parked.load(std::memory_order_relaxed));
+  }
+
+  // let only the first n workers take jobs, from any thread: the others
+  // park once done with the one they run, what they queued left to steal
+
+  void allow(size_type n) noexcept {
+    m_allowed.store(std::clamp<size_type>(n, 1, size()), std::memory_order_relaxed);
+
+    std::lock_guard guard{ m_idle_mtx };
+
+    m_park_cv.notify_all();
+  }
+
+  inline size_type allowed() const noexcept { return m_allowed.load(std::memory_order_relaxed); }
+
+  // stop handing out jobs, from any thread: those still queued are
+  // dropped and run() returns as soon as the running ones are done
+
+  void cancel() noexcept {
+    m_cancelled.store(true, std::memory_order_release);
+
+    std::lock_guard guard{ m_idle_mtx };
+
+    m_idle_cv.notify_all();
+    m_park_cv.notify_all();
+  }
+
+  inline auto cancelled() const noexcept -> bool { return m_cancelled.load(std::memory_order_relaxed); }
+
+  // while held, from any thread, only the jobs queued with expedite() are
+  // handed out: the others wait for the hold to be lifted
+
+  void hold(bool on) noexcept {
+    if (m_held.exchange(on, std::memory_order_acq_rel) == on || on)
+      return;
+
+    m_epoch.fetch_add(1);
+
+    std::lock_guard guard{ m_idle_mtx };
+
+    m_idle_cv.notify_all();
+  }
+
+  inline auto held() const noexcept -> bool { return m_held.load(std::memory_order_relaxed); }
+
+  // jobs carrying a lane() (e.g. the device they are on) are run at most
+  // cap at once for each lane, lanes past max_lanes share the last one
+
+  static constexpr size_type max_lanes = 64;
+
+  void limit(size_type lane, size_type cap) noexcept {
+    m_lanes[std::min(lane, max_lanes - 1)].cap.store(std::max<size_type>(cap, 1), std::memory_order_relaxed);
+  }
+
+  static auto lane_of(const Job& job) noexcept -> size_type {
+    if constexpr (requires { job.lane(); })
+      return std::min<size_type>(job.lane(), max_lanes - 1);
+    else
+      return 0;
+  }
+
+  // run a job outside of the pool, within the cap of its lane: false if
+  // the lane has no slot left, leave() once it has run otherwise
+
+  inline auto enter(const Job& job) noexcept -> bool { return admit(job); }
+
+  inline void leave(const Job& job) { release(lane_of(job)); }
+
+  // once run() returned, hand the jobs a cancel() left queued to fn
+
+  void drain(auto&& fn) {
+    for (auto& job : m_urgent)
+      fn(job);
+
+    m_urgent.clear();
+    m_urgent_count = 0;
+
+    for (auto& w : m_workers) {
+      for (auto& q : w.lanes)
+        for (auto& [seq, job] : q.jobs)
+          fn(job);
+
+      w.lanes.clear();
+    }
+
+    m_queued = 0;
+    m_pending = 0;
+  }
+
+  // queue a job on the deque of the calling worker, or on the first one
+  // when called from outside the pool (i.e. to seed it)
+
+  void push(Job job) {
+    auto& w = m_workers[index()];
+
+    m_pending.fetch_add(1);
+
+    {
+      std::lock_guard guard{ w.mtx };
+
+      auto lane = lane_of(job);
+
+      auto q = std::ranges::find(w.lanes, lane, &lane_jobs::lane);
+
+      if (q == w.lanes.end())
+        q = w.lanes.insert(q, lane_jobs{ lane, {} });
+
+      q->jobs.push_back({ w.pushed++, std::move(job) });
+    }
+
+    m_epoch.fetch_add(1);
+
+    auto queued = m_queued.fetch_add(1) + 1;
+
+    for (auto high = m_high.load(std::memory_order_relaxed); queued > high;)
+      if (m_high.compare_exchange_weak(high, queued, std::memory_order_relaxed))
+        break;
+
+    if (m_sleeping.load() != 0) {
+      std::lock_guard guard{ m_idle_mtx };
+
+      m_idle_cv.notify_one();
+    }
+  }
+
+  // queue a job to be handed out before any other, from any thread, held
+  // or not
+
+  void expedite(Job job) {
+    m_pending.fetch_add(1);
+
+    {
+      std::lock_guard guard{ m_urgent_mtx };
+
+      m_urgent.push_back(std::move(job));
+    }
+
+    m_urgent_count.fetch_add(1);
+    m_queued.fetch_add(1);
+    m_epoch.fetch_add(1);
+
+    std::lock_guard guard{ m_idle_mtx };
+
+    m_idle_cv.notify_one();
+  }
+
+  // run fn over every job, including the ones it pushes, on size() threads
+  // and return once nothing is queued nor running anymore
+
+  void run(auto&& fn) {
+    auto threads = std::vector<std::thread>{};
+
+    threads.reserve(size());
+
+    for (size_type i = 0; i < size(); ++i)
+      threads.emplace_back([this, i, &fn]() { work(i, fn); });
+
+    for (auto& t : threads)
+      t.join();
+  }
+
+private:
+
+  // the jobs of a worker, a deque per lane: those of a lane at its cap are
+  // passed over at once, however many. Each job is numbered as pushed for
+  // the newest, or the oldest, to be found across them.
+
+  struct lane_jobs {
+    size_type lane;
+    std::deque<std::pair<size_type, Job>> jobs;
+  };
+
+  struct worker {
+    std::mutex mtx;
+    std::vector<lane_jobs> lanes;
+    size_type pushed = 0;
+  };
+
+  struct lane {
+    std::atomic<size_type> cap{ SIZE_MAX };
+    std::atomic<size_type> running{ 0 };
+  };
+
+  // take a running slot of lane, if it has one left
+
+  auto admit(size_type lane) noexcept -> bool {
+    auto& l = m_lanes[lane];
+
+    if (l.running.fetch_add(1) < l.cap.load(std::memory_order_relaxed))
+      return true;
+
+    l.running.fetch_sub(1);
+
+    return false;
+  }
+
+  inline auto admit(const Job& job) noexcept -> bool { return admit(lane_of(job)); }
+
+  inline auto full(size_type lane) const noexcept -> bool {
+    return m_lanes[lane].running.load(std::memory_order_relaxed) >= m_lanes[lane].cap.load(std::memory_order_relaxed);
+  }
+
+  // the newest job of w, or the oldest, of a lane that can be admitted
+
+  auto take(worker& w, bool newest) -> std::optional<Job> {
+    std::lock_guard guard{ w.mtx };
+
+    // the lanes found full, by their index in w.lanes
+
+    auto passed = std::uint64_t{};
+
+    while (true) {
+      auto* best = static_cast<lane_jobs*>(nullptr);
+
+      for (size_type k = 0; k < w.lanes.size(); ++k) {
+        auto& q = w.lanes[k];
+
+        if (q.jobs.empty() || (passed >> k & 1) || full(q.lane))
+          continue;
+
+        if (!best || (newest ? q.jobs.back().first > best->jobs.back().first : q.jobs.front().first < best->jobs.front().first))
+          best = &q;
+      }
+
+      if (!best)
+        return {};
+
+      if (!admit(best->lane)) {
+        passed |= std::uint64_t{ 1 } << (best - w.lanes.data());
+
+        continue;
+      }
+
+      auto job = std::move(newest ? best->jobs.back().second : best->jobs.front().second);
+
+      if (newest)
+        best->jobs.pop_back();
+      else
+        best->jobs.pop_front();
+
+      m_queued.fetch_sub(1);
+
+      return job;
+    }
+  }
+
+  // the job of the range that can be admitted, the first one
+
+  auto take(std::deque<Job>& jobs, auto first, auto last) -> std::optional<Job> {
+    for (auto it = first; it != last; ++it)
+      if (admit(*it)) {
+        auto job = std::move(*it);
+
+        if constexpr (std::is_same_v<decltype(it), typename std::deque<Job>::reverse_iterator>)
+          jobs.erase(std::next(it).base());
+        else
+          jobs.erase(it);
+
+        m_queued.fetch_sub(1);
+
+        return job;
+      }
+
+    return {};
+  }
+
+  auto pop(size_type i) -> std::optional<Job> {
+    if (m_cancelled.load(std::memory_order_acquire))
+      return {};
+
+    // the jobs expedited are few, the queue is looked at only once they are
+    // there
+
+    if (m_urgent_count.load() != 0) {
+      std::lock_guard guard{ m_urgent_mtx };
+
+      if (auto job = take(m_urgent, m_urgent.begin(), m_urgent.end())) {
+        m_urgent_count.fetch_sub(1);
+
+        return job;
+      }
+    }
+
+    if (held())
+      return {};
+
+    // take the newest job of our own deques first: this keeps each worker
+    // descending depth-first into the subtree it is already walking; only
+    // jobs of a lane at its cap are passed over
+
+    if (auto job = take(m_workers[i], true))
+      return job;
+
+    // otherwise steal the oldest job of another worker, which is the
+    // shallowest one and so likely the biggest subtree left
+
+    for (size_type k = 1; k < size(); ++k)
+      if (auto job = take(m_workers[(i + k) % size()], false))
+        return job;
+
+    return {};
+  }
+
+  // give a slot of lane back, waking one of those that passed its jobs
+  // over when it was full: there is room for one more
+
+  void release(size_type i) {
+    auto& l = m_lanes[i];
+
+    auto full = l.running.fetch_sub(1) >= l.cap.load(std::memory_order_relaxed);
+
+    if (full) {
+      m_epoch.fetch_add(1);
+
+      if (m_sleeping.load() != 0) {
+        std::lock_guard guard{ m_idle_mtx };
+
+        m_idle_cv.notify_one();
+      }
+    }
+  }
+
+  void work(size_type i, auto& fn) {
+    t_pool = this;
+    t_index = i;
+
+    auto over = [&]() { return m_pending.load() == 0 || cancelled(); };
+
+    while (true) {
+      if (i >= allowed()) {
+        std::unique_lock lck{ m_idle_mtx };
+
+        m_parked.fetch_add(1);
+
+        m_park_cv.wait(lck, [&]() { return i < allowed() || over(); });
+
+        m_parked.fetch_sub(1);
+
+        if (over())
+          break;
+
+        continue;
+      }
+
+      // anything pushed or released from now on may be a job we can take,
+      // even when pop() finds none
+
+      auto seen = m_epoch.load();
+
+      if (auto job = pop(i)) {
+        // the job may well be gone once run
+
+        auto lane = lane_of(*job);
+
+        fn(*job);
+
+        release(lane);
+
+        // a job is in flight until it has run, hence after it had the chance
+        // to push its children: reaching zero means the walk is over
+
+        if (m_pending.fetch_sub(1) == 1) {
+          std::lock_guard guard{ m_idle_mtx };
+
+          m_idle_cv.notify_all();
+          m_park_cv.notify_all();
+        }
+
+        continue;
+      }
+
+      std::unique_lock lck{ m_idle_mtx };
+
+      m_sleeping.fetch_add(1);
+
+      m_idle_cv.wait(lck, [&]() { return m_epoch.load() != seen || over() || i >= allowed(); });
+
+      m_sleeping.fetch_sub(1);
+
+      if (over())
+        break;
+    }
+
+    t_pool = nullptr;
+  }
+
+  std::vector<worker> m_workers;
+
+  std::atomic<size_type> m_pending{ 0 };
+
+  std::atomic<size_type> m_queued{ 0 };
+
+  std::atomic<size_type> m_sleeping{ 0 };
+
+  std::atomic<size_type> m_parked{ 0 };
+
+  std::atomic<size_type> m_allowed;
+
+  std::atomic<size_type> m_high{ 0 };
+
+  std::atomic<size_type> m_epoch{ 0 };
+
+  std::array<lane, max_lanes> m_lanes;
+
+  std::mutex m_urgent_mtx;
+
+  std::deque<Job> m_urgent;
+
+  std::atomic<size_type> m_urgent_count{ 0 };
+
+  std::atomic<bool> m_held{ false };
+
+  std::atomic<bool> m_cancelled{ false };
+
+  std::mutex m_idle_mtx;
+
+  std::condition_variable m_idle_cv;
+
+  // for the workers past allowed()
+
+  std::condition_variable m_park_cv;
+
+  static inline thread_local const work_pool* t_pool = nullptr;
+
+  static inline thread_local size_type t_index = 0;
+};
+
+struct output {
+
+public:
+
+  using size_type = std::size_t;
+
+  // a per-worker buffer: entries are appended without any locking and handed
+  // over to the writer in chunk_size pieces
+
+  struct buffer {
+
+  public:
+
+    // append one entry, chunks only ever break between entries so that
+    // lines from different workers never interleave
+
+    inline void append(std::string_view s) {
+      m_data.append(s);
+      m_data.push_back(m_out->m_end);
+
+      if (m_data.size() >= chunk_size)
+        flush();
+    }
+
+    // append entries that come with their terminators already
+
+    inline void append_entries(std::string_view s) {
+      m_data.append(s);
+
+      if (m_data.size() >= chunk_size)
+        flush();
+    }
+
+    // append the entry name found in the directory dir
+
+    inline void append(std::string_view dir, std::string_view name) {
+      m_data.append(dir);
+
+      if (!dir.ends_with('/'))
+        m_data.push_back('/');
+
+      append(name);
+    }
+
+    void flush() {
+      if (m_data.empty())
+        return;
+
+      m_data = m_out->push(std::move(m_data));
+
+      m_data.reserve(chunk_size + chunk_reserve);
+    }
+
+  private:
+
+    friend output;
+
+    buffer(output* out) : m_out{ out } { m_data.reserve(chunk_size + chunk_reserve); }
+
+    output* m_out;
+
+    std::string m_data;
+  };
+
+  static constexpr size_type chunk_size = 64 * 1024;
+
+  explicit output(size_type n, char end = '\n')
+    : m_end{ end }
+  {
+    m_buffers.reserve(n);
+
+    for (size_type i = 0; i < n; ++i)
+      m_buffers.push_back(buffer{ this });
+
+    m_writer = std::thread{ [this]() { write(); } };
+  }
+
+  output(const output&) = delete;
+
+  output& operator=(const output&) = delete;
+
+  ~output() { close(); }
+
+  inline auto operator[](size_type i) noexcept -> buffer& { return m_buffers[i]; }
+
+  // flush every buffer and wait for the writer to drain them, false if
+  // some of the output could not be written
+
+  auto close() -> bool {
+    if (!m_writer.joinable())
+      return !m_failed;
+
+    for (auto& b : m_buffers)
+      b.flush();
+
+    {
+      std::lock_guard guard{ m_mtx };
+
+      m_done = true;
+    }
+
+    m_ready_cv.notify_one();
+
+    m_writer.join();
+
+    return !m_failed;
+  }
+
+private:
+
+  // room for the entry that makes a buffer cross chunk_size
+
+  static constexpr size_type chunk_reserve = 4 * 1024;
+
+  // chunks queued before producers wait for the writer to catch up
+
+  static constexpr size_type max_chunks = 64;
+
+  // queue a chunk and get an empty one back to fill, recycled from those
+  // already written when there is any
+
+  auto push(std::string chunk) -> std::string {
+    auto spare = std::string{};
+
+    std::unique_lock lck{ m_mtx };
+
+    m_room_cv.wait(lck, [&]() { return m_chunks.size() < max_chunks; });
+
+    m_chunks.push_back(std::move(chunk));
+
+    if (!m_spare.empty()) {
+      spare = std::move(m_spare.back());
+
+      m_spare.pop_back();
+    }
+
+    lck.unlock();
+
+    m_ready_cv.notify_one();
+
+    return spare;
+  }
+
+  void write() {
+    auto chunks = std::vector<std::string>{};
+
+    while (true) {
+      {
+        std::unique_lock lck{ m_mtx };
+
+        m_ready_cv.wait(lck, [&]() { return m_done || !m_chunks.empty(); });
+
+        if (m_chunks.empty())
+          break;
+
+        chunks.swap(m_chunks);
+      }
+
+      m_room_cv.notify_all();
+
+      // keep draining after a failure, so producers never block
+
+      if (!m_failed)
+        m_failed = !write_all(chunks);
+
+      for (auto& c : chunks)
+        c.clear();
+
+      std::lock_guard guard{ m_mtx };
+
+      std::move(chunks.begin(), chunks.end(), std::back_inserter(m_spare));
+
+      chunks.clear();
+    }
+  }
+
+#if defined(_WIN32)
+
+  static auto write_all(const std::vector<std::string>& chunks) -> bool {
+    for (auto& c : chunks) {
+      stats::add(stats::writes);
+
+      if (std::fwrite(c.data(), 1, c.size(), stdout) != c.size())
+        return false;
+    }
+
+    return std::fflush(stdout) == 0;
+  }
+
+#else
+
+  // gather the chunks straight into write(2) calls, bypassing stdio and
+  // iostreams entirely
+
+  static auto write_all(const std::vector<std::string>& chunks) -> bool {
+    constexpr auto max_iov = std::size_t{ IOV_MAX < 1024 ? IOV_MAX : 1024 };
+
+    iovec iov[max_iov];
+
+    for (std::size_t i = 0; i < chunks.size();) {
+      auto n = std::min(chunks.size() - i, max_iov);
+
+      for (std::size_t k = 0; k < n; ++k)
+        iov[k] = { const_cast<char*>(chunks[i + k].data()), chunks[i + k].size() };
+
+      auto* v = iov;
+      auto cnt = static_cast<int>(n);
+
+      while (cnt > 0) {
+        auto r = ::writev(STDOUT_FILENO, v, cnt);
+
+        stats::add(stats::writes);
+
+        if (r < 0) {
+          if (errno == EINTR)
+            continue;
+
+          return false;
+        }
+
+        // skip what went out, then retry the remainder of a partial write
+
+        auto done = static_cast<std::size_t>(r);
+
+        while (cnt > 0 && done >= v->iov_len) {
+          done -= v->iov_len;
+
+          ++v;
+          --cnt;
+        }
+
+        if (cnt > 0) {
+          v->iov_base = static_cast<char*>(v->iov_base) + done;
+          v->iov_len -= done;
+        }
+      }
+
+      i += n;
+    }
+
+    return true;
+  }
+
+#endif
+
+  const char m_end;
+
+  std::vector<buffer> m_buffers;
+
+  std::mutex m_mtx;
+
+  std::condition_variable m_ready_cv;
+
+  std::condition_variable m_room_cv;
+
+  std::vector<std::string> m_chunks;
+
+  std::vector<std::string> m_spare;
+
+  bool m_done = false;
+
+  bool m_failed = false;
+
+  std::thread m_writer;
+};
+
+// byte string kernels behind the literal fast paths of glob, vectorized with
+// whatever the target enables (AVX2, SSE2 or NEON) and scalar otherwise. The
+// icase variants fold ASCII letters of the haystack only: the literal side is
+// expected to be lower case already.
+
+struct simd {
+
+public:
+
+  static auto equal(const char* a, const char* b, std::size_t n) noexcept -> bool {
+    if (n < 16)
+      return equal_short<false>(a, b, n);
+
+    return equal_long<false>(a, b, n);
+  }
+
+  static auto equal_icase(const char* a, const char* b, std::size_t n) noexcept -> bool {
+    if (n < 16)
+      return equal_short<true>(a, b, n);
+
+    return equal_long<true>(a, b, n);
+  }
+
+  // whether needle occurs in hay, needle not empty
+
+  static auto contains(std::string_view hay, std::string_view needle, bool icase) noexcept -> bool {
+    if (needle.size() > hay.size())
+      return false;
+
+    return icase ? search<true>(hay, needle) : search<false>(hay, needle);
+  }
+
+private:
+
+  static inline auto lower(unsigned char c) noexcept -> unsigned char {
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+  }
+
+  template<typename T>
+  static inline auto load(const char* p) noexcept -> T {
+    auto v = T{};
+
+    std::memcpy(&v, p, sizeof(T));
+
+    return v;
+  }
+
+  // ASCII to lower case of every byte in a word at once
+
+  template<typename T>
+  static inline auto lower(T x) noexcept -> T {
+    constexpr auto ones = static_cast<T>(~T{ 0 } / 0xff);
+
+    auto low7 = x & (ones * 0x7f);
+    auto ge_a = low7 + ones * (0x80 - 'A');
+    auto gt_z = low7 + ones * (0x7f - 'Z');
+    auto upper = (ge_a ^ gt_z) & ~x & (ones * 0x80);
+
+    return x | (upper >> 2);
+  }
+
+  // below 16 bytes compare with two possibly overlapping words, covering
+  // the range from both ends
+
+  template<bool Icase, typename T>
+  static inline auto equal_words(const char* a, const char* b, std::size_t n) noexcept -> bool {
+    auto fa = load<T>(a), la = load<T>(a + n - sizeof(T));
+    auto fb = load<T>(b), lb = load<T>(b + n - sizeof(T));
+
+    if constexpr (Icase) {
+      fa = lower(fa);
+      la = lower(la);
+    }
+
+    return ((fa ^ fb) | (la ^ lb)) == 0;
+  }
+
+  template<bool Icase>
+  static inline auto equal_short(const char* a, const char* b, std::size_t n) noexcept -> bool {
+    if (n >= 8)
+      return equal_words<Icase, std::uint64_t>(a, b, n);
+
+    if (n >= 4)
+      return equal_words<Icase, std::uint32_t>(a, b, n);
+
+    for (std::size_t i = 0; i < n; ++i)
+      if ((Icase ? lower(static_cast<unsigned char>(a[i])) : static_cast<unsigned char>(a[i])) != static_cast<unsigned char>(b[i]))
+        return false;
+
+    return true;
+  }
+
+#if defined(__AVX2__)
+
+  using vec = __m256i;
+
+  static constexpr std::size_t width = 32;
+
+  static inline auto vload(const char* p) noexcept -> vec { return _mm256_loadu_si256(reinterpret_cast<const vec*>(p)); }
+
+  static inline auto vsplat(char c) noexcept -> vec { return _mm256_set1_epi8(c); }
+
+  static inline auto vlower(vec x) noexcept -> vec {
+    auto upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), _mm256_add_epi8(x, _mm256_set1_epi8(static_cast<char>(0x80 - 'A'))));
+
+    return _mm256_or_si256(x, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+  }
+
+  // one bit per byte lane, set where both vectors are equal
+
+  static inline auto veq(vec a, vec b) noexcept -> std::uint32_t {
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+  }
+
+  static inline auto vand(std::uint32_t a, std::uint32_t b) noexcept -> std::uint32_t { return a & b; }
+
+  static constexpr std::uint32_t all = 0xffffffff;
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+  using vec = __m128i;
+
+  static constexpr std::size_t width = 16;
+
+  static inline auto vload(const char* p) noexcept -> vec { return _mm_loadu_si128(reinterpret_cast<const vec*>(p)); }
+
+  static inline auto vsplat(char c) noexcept -> vec { return _mm_set1_epi8(c); }
+
+  static inline auto vlower(vec x) noexcept -> vec {
+    auto upper = _mm_cmplt_epi8(_mm_add_epi8(x, _mm_set1_epi8(static_cast<char>(0x80 - 'A'))), _mm_set1_epi8(-128 + 26));
+
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+  }
+
+  static inline auto veq(vec a, vec b) noexcept -> std::uint32_t {
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+  }
+
+  static inline auto vand(std::uint32_t a, std::uint32_t b) noexcept -> std::uint32_t { return a & b; }
+
+  static constexpr std::uint32_t all = 0xffff;
+
+#elif defined(__ARM_NEON)
+
+  using vec = uint8x16_t;
+
+  static constexpr std::size_t width = 16;
+
+  static inline auto vload(const char* p) noexcept -> vec { return vld1q_u8(reinterpret_cast<const std::uint8_t*>(p)); }
+
+  static inline auto vsplat(char c) noexcept -> vec { return vdupq_n_u8(static_cast<std::uint8_t>(c)); }
+
+  static inline auto vlower(vec x) noexcept -> vec {
+    auto upper = vcltq_u8(vsubq_u8(x, vdupq_n_u8('A')), vdupq_n_u8(26));
+
+    return vorrq_u8(x, vandq_u8(upper, vdupq_n_u8(0x20)));
+  }
+
+  // NEON has no movemask: narrow each 0x00/0xff lane to a nibble instead,
+  // so the mask carries four bits per byte
+
+  static inline auto veq(vec a, vec b) noexcept -> std::uint64_t {
+    auto eq = vreinterpretq_u16_u8(vceqq_u8(a, b));
+
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(eq, 4)), 0);
+  }
+
+  static inline auto vand(std::uint64_t a, std::uint64_t b) noexcept -> std::uint64_t { return a & b; }
+
+  static constexpr std::uint64_t all = ~std::uint64_t{ 0 };
+
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || defined(__ARM_NEON)
+
+  static constexpr std::size_t lane_bits = width == 16 && sizeof(all) == 8 ? 4 : 1;
+
+  static constexpr auto lane_mask = static_cast<decltype(all + 0)>((1u << lane_bits) - 1);
+
+  template<bool Icase>
+  static inline auto vfold(vec x) noexcept -> vec {
+    if constexpr (Icase)
+      return vlower(x);
+    else
+      return x;
+  }
+
+  // 16 bytes and more: whole vectors, then one last vector flush with the
+  // end that may overlap the previous one
+
+  template<bool Icase>
+  static auto equal_long(const char* a, const char* b, std::size_t n) noexcept -> bool {
+    if (n < width)
+      return equal_words_long<Icase>(a, b, n);
+
+    for (std::size_t i = 0; i + width <= n; i += width)
+      if (veq(vfold<Icase>(vload(a + i)), vload(b + i)) != all)
+        return false;
+
+    return veq(vfold<Icase>(vload(a + n - width)), vload(b + n - width)) == all;
+  }
+
+  // compare the first and last byte of the needle against width candidate
+  // positions at once and verify only the positions where both agree
+
+  template<bool Icase>
+  static auto search(std::string_view hay, std::string_view needle) noexcept -> bool {
+    auto m = needle.size();
+
+    auto first = vsplat(needle.front());
+    auto last = vsplat(needle.back());
+
+    std::size_t i = 0;
+
+    for (; i + m - 1 + width <= hay.size(); i += width) {
+      auto hits = vand(
+        veq(vfold<Icase>(vload(hay.data() + i)), first),
+        veq(vfold<Icase>(vload(hay.data() + i + m - 1)), last));
+
+      while (hits != 0) {
+        auto k = static_cast<std::size_t>(std::countr_zero(hits)) / lane_bits;
+
+        if (m <= 2 || equal_any<Icase>(hay.data() + i + k + 1, needle.data() + 1, m - 2))
+          return true;
+
+        hits &= ~(lane_mask << (k * lane_bits));
+      }
+    }
+
+    return search_scalar<Icase>(hay.substr(i), needle);
+  }
+
+#else
+
+  template<bool Icase>
+  static auto equal_long(const char* a, const char* b, std::size_t n) noexcept -> bool {
+    return equal_words_long<Icase>(a, b, n);
+  }
+
+  template<bool Icase>
+  static auto search(std::string_view hay, std::string_view needle) noexcept -> bool {
+    return search_scalar<Icase>(hay, needle);
+  }
+
+#endif
+
+  // 8 bytes at a time, the last word flush with the end
+
+  template<bool Icase>
+  static auto equal_words_long(const char* a, const char* b, std::size_t n) noexcept -> bool {
+    for (std::size_t i = 0; i + 8 <= n; i += 8)
+      if (!equal_words<Icase, std::uint64_t>(a + i, b + i, 8))
+        return false;
+
+    return equal_words<Icase, std::uint64_t>(a + n - 8, b + n - 8, 8);
+  }
+
+  template<bool Icase>
+  static inline auto equal_any(const char* a, const char* b, std::size_t n) noexcept -> bool {
+    return n < 16 ? equal_short<Icase>(a, b, n) : equal_long<Icase>(a, b, n);
+  }
+
+  template<bool Icase>
+  static auto search_scalar(std::string_view hay, std::string_view needle) noexcept -> bool {
+    if constexpr (!Icase) {
+      return hay.find(needle) != std::string_view::npos;
+    }
+    else {
+      for (std::size_t i = 0; i + needle.size() <= hay.size(); ++i)
+        if (equal_any<true>(hay.data() + i, needle.data(), needle.size()))
+          return true;
+
+      return false;
+    }
+  }
+};
+
+// fnmatch-style pattern, as used by -name and -iname: `*` matches any run of
+// bytes, `?` a single byte, `[...]` a set of bytes (with ranges and `!` or `^`
+// to negate it) and `\` escapes the next byte. Patterns are compiled once and
+// matched without allocating; the leading and trailing literal runs are
+// checked up front as they reject most names before the general loop runs.
+// The common shapes, a plain literal or a literal with stars at the start
+// and/or the end, skip the general loop entirely.
+
+struct glob {
+
+public:
+
+  static auto compile(std::string_view pattern, bool icase) -> glob {
+    auto obj = glob{};
+
+    obj.m_icase = icase;
+
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+      auto c = static_cast<unsigned char>(pattern[i]);
+
+      switch (c) {
+
+      case '*':
+        if (obj.m_tokens.empty() || obj.m_tokens.back().kind != token::star)
+          obj.m_tokens.push_back({ token::star });
+
+        continue;
+
+      case '?':
+        obj.m_tokens.push_back({ token::any });
+
+        continue;
+
+      case '[':
+        if (auto n = obj.parse_set(pattern.substr(i + 1))) {
+          i += n;
+
+          continue;
+        }
+
+        break; // unterminated, it is a plain '['
+
+      case '\\':
+        if (i + 1 < pattern.size())
+          c = static_cast<unsigned char>(pattern[++i]);
+
+        break;
+      }
+
+      obj.m_tokens.push_back({ token::literal, obj.fold(c) });
+    }
+
+    // split off the literal runs at both ends, the suffix only when a star
+    // separates it from the prefix
+
+    auto& t = obj.m_tokens;
+
+    while (obj.m_head < t.size() && t[obj.m_head].kind == token::literal)
+      obj.m_prefix.push_back(static_cast<char>(t[obj.m_head++].ch));
+
+    obj.m_tail = t.size();
+
+    if (obj.m_head < t.size()) {
+      while (t[obj.m_tail - 1].kind == token::literal)
+        --obj.m_tail;
+
+      for (auto k = obj.m_tail; k < t.size(); ++k)
+        obj.m_suffix.push_back(static_cast<char>(t[k].ch));
+    }
+
+    for (auto& k : t)
+      obj.m_min_size += k.kind != token::star;
+
+    obj.m_shape = obj.classify();
+
+    return obj;
+  }
+
+  auto match(std::string_view name) const noexcept -> bool {
+    switch (m_shape) {
+
+    case shape::exact:
+      return name.size() == m_prefix.size() && literal_at(name, 0, m_prefix);
+
+    case shape::prefix:
+      return name.size() >= m_prefix.size() && literal_at(name, 0, m_prefix);
+
+    case shape::suffix:
+      return name.size() >= m_suffix.size() && literal_at(name, name.size() - m_suffix.size(), m_suffix);
+
+    case shape::contains:
+      return simd::contains(name, m_infix, m_icase);
+
+    case shape::general:
+      break;
+    }
+
+    if (name.size() < m_min_size)
+      return false;
+
+    if (!literal_at(name, 0, m_prefix))
+      return false;
+
+    if (!literal_at(name, name.size() - m_suffix.size(), m_suffix))
+      return false;
+
+    // only literals, and the size was checked: done
+
+    if (m_head == m_tokens.size())
+      return name.size() == m_prefix.size();
+
+    return match_body(name.substr(m_prefix.size(), name.size() - m_prefix.size() - m_suffix.size()));
+  }
+
+  auto icase() const noexcept -> bool { return m_icase; }
+
+private:
+
+  friend struct glob_set;
+
+  struct token {
+    enum kind : std::uint8_t {
+      literal,
+      any,
+      star,
+      set,
+    } kind;
+
+    std::uint8_t ch = 0;
+
+    std::uint16_t index = 0;
+  };
+
+  enum class shape : std::uint8_t {
+    exact,    // "lit"
+    prefix,   // "lit*"
+    suffix,   // "*lit"
+    contains, // "*lit*"
+    general,
+  };
+
+  auto classify() -> shape {
+    auto& t = m_tokens;
+
+    if (m_head == t.size())
+      return shape::exact;
+
+    if (m_head + 1 == t.size() && t.back().kind == token::star)
+      return shape::prefix;
+
+    if (t.front().kind != token::star)
+      return shape::general;
+
+    if (m_tail == 1)
+      return shape::suffix;
+
+    if (t.size() > 2 && t.back().kind == token::star) {
+      for (std::size_t k = 1; k + 1 < t.size(); ++k)
+        if (t[k].kind != token::literal)
+          return shape::general;
+
+        else
+          m_infix.push_back(static_cast<char>(t[k].ch));
+
+      return shape::contains;
+    }
+
+    return shape::general;
+  }
+
+  // one bit per byte value
+
+  using byte_set = std::array<std::uint64_t, 4>;
+
+  static inline auto has(const byte_set& s, unsigned char c) noexcept -> bool {
+    return (s[c >> 6] >> (c & 63)) & 1;
+  }
+
+  static inline void add(byte_set& s, unsigned char c) noexcept {
+    s[c >> 6] |= std::uint64_t{ 1 } << (c & 63);
+  }
+
+  static inline auto lower(unsigned char c) noexcept -> unsigned char {
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+  }
+
+  inline auto fold(unsigned char c) const noexcept -> unsigned char {
+    return m_icase ? lower(c) : c;
+  }
+
+  // parse the set following a '[', return how many bytes it took including
+  // the closing ']' or zero if it is not terminated
+
+  auto parse_set(std::string_view s) -> std::size_t {
+    auto set = byte_set{};
+
+    std::size_t i = 0;
+
+    bool negate = i < s.size() && (s[i] == '!' || s[i] == '^');
+
+    if (negate)
+      ++i;
+
+    for (auto first = true; i < s.size(); first = false, ++i) {
+      auto c = static_cast<unsigned char>(s[i]);
+
+      if (c == ']' && !first)
+        break;
+
+      if (c == '[' && i + 1 < s.size() && s[i + 1] == ':')
+        if (auto n = parse_class(s.substr(i + 2), set)) {
+          i += n + 1;
+
+          continue;
+        }
+
+      if (c == '\\' && i + 1 < s.size())
+        c = static_cast<unsigned char>(s[++i]);
+
+      auto last = c;
+
+      if (i + 2 < s.size() && s[i + 1] == '-' && s[i + 2] != ']') {
+        i += 2;
+
+        last = static_cast<unsigned char>(s[i]);
+
+        if (last == '\\' && i + 1 < s.size())
+          last = static_cast<unsigned char>(s[++i]);
+      }
+
+      for (unsigned v = c; v <= last; ++v) {
+        add(set, static_cast<unsigned char>(v));
+
+        if (m_icase)
+          add(set, lower(static_cast<unsigned char>(v)));
+      }
+    }
+
+    if (i >= s.size())
+      return 0;
+
+    if (negate)
+      for (auto& w : set)
+        w = ~w;
+
+    m_tokens.push_back({ token::set, 0, static_cast<std::uint16_t>(m_sets.size()) });
+
+    m_sets.push_back(set);
+
+    return i + 1;
+  }
+
+  // parse a named class following a "[:", like "alpha:]", return how many
+  // bytes it took or zero if it is not one
+
+  auto parse_class(std::string_view s, byte_set& set) const noexcept -> std::size_t {
+    constexpr std::pair<std::string_view, int (*)(int)> classes[] = {
+      { "alnum", std::isalnum }, { "alpha", std::isalpha }, { "blank", std::isblank },
+      { "cntrl", std::iscntrl }, { "digit", std::isdigit }, { "graph", std::isgraph },
+      { "lower", std::islower }, { "print", std::isprint }, { "punct", std::ispunct },
+      { "space", std::isspace }, { "upper", std::isupper }, { "xdigit", std::isxdigit },
+    };
+
+    auto end = s.find(":]");
+
+    if (end == std::string_view::npos)
+      return 0;
+
+    for (auto& [name, pred] : classes)
+      if (s.substr(0, end) == name) {
+        for (int c = 0; c < 128; ++c)
+          if (pred(c))
+            add(set, fold(static_cast<unsigned char>(c)));
+
+        return end + 2;
+      }
+
+    return 0;
+  }
+
+  auto literal_at(std::string_view name, std::size_t pos, const std::string& lit) const noexcept -> bool {
+    return m_icase
+      ? simd::equal_icase(name.data() + pos, lit.data(), lit.size())
+      : simd::equal(name.data() + pos, lit.data(), lit.size());
+  }
+
+  inline auto match_one(const token& t, unsigned char c) const noexcept -> bool {
+    switch (t.kind) {
+
+    case token::literal: return fold(c) == t.ch;
+    case token::any: return true;
+    case token::set: return has(m_sets[t.index], fold(c));
+    case token::star: return false;
+
+    }
+    return false;
+  }
+
+  // match the tokens in [m_head, m_tail) against the whole of name: on a
+  // mismatch resume after the last star seen, consuming one more byte with
+  // it; a single backtrack point is enough since a star matches anything
+
+  auto match_body(std::string_view name) const noexcept -> bool {
+    auto p = m_head;
+    auto n = std::size_t{ 0 };
+
+    auto star_p = std::string_view::npos;
+    auto star_n = std::size_t{ 0 };
+
+    while (n < name.size()) {
+      if (p < m_tail && m_tokens[p].kind == token::star) {
+        star_p = ++p;
+        star_n = n;
+      }
+      else if (p < m_tail && match_one(m_tokens[p], static_cast<unsigned char>(name[n]))) {
+        ++p;
+        ++n;
+      }
+      else if (star_p != std::string_view::npos) {
+        p = star_p;
+        n = ++star_n;
+      }
+      else {
+        return false;
+      }
+    }
+
+    while (p < m_tail && m_tokens[p].kind == token::star)
+      ++p;
+
+    return p == m_tail;
+  }
+
+  std::vector<token> m_tokens;
+
+  std::vector<byte_set> m_sets;
+
+  std::string m_prefix;
+
+  std::string m_suffix;
+
+  std::string m_infix;
+
+  std::size_t m_head = 0;
+
+  std::size_t m_tail = 0;
+
+  std::size_t m_min_size = 0;
+
+  shape m_shape = shape::general;
+
+  bool m_icase = false;
+};
+
+// globs that are a literal anchored at both ends or at one, "lit", "lit*"
+// and "*lit", looked up all at once: the name, and its prefix and suffix of
+// every size some pattern has, are hashed and looked for among the
+// literals, so that the cost of -name a -o -name b -o ... depends on how
+// many sizes the literals come in rather than on how many there are.
+// Extensions, "*.ext" with no other dot, take a single lookup of whatever
+// follows the last dot of the name, whatever their sizes.
+
+struct glob_set {
+
+public:
+
+  // longer literals are left to the glob they come from
+
+  static constexpr std::size_t max_literal = 255;
+
+  static auto accepts(const glob& g) noexcept -> bool {
+    switch (g.m_shape) {
+
+    case glob::shape::exact:
+    case glob::shape::prefix:
+      return g.m_prefix.size() <= max_literal;
+
+    case glob::shape::suffix:
+      return g.m_suffix.size() <= max_literal;
+
+    case glob::shape::contains:
+    case glob::shape::general:
+      break;
+    }
+
+    return false;
+  }
+
+  explicit glob_set(bool icase) noexcept : m_icase{ icase } {}
+
+  // g is accepted and of the same case sensitivity as the set
+
+  void add(const glob& g) {
+    switch (g.m_shape) {
+
+    case glob::shape::exact:
+      m_exact.insert(g.m_prefix);
+
+      break;
+
+    case glob::shape::prefix:
+      table_of(m_prefixes, g.m_prefix.size()).insert(g.m_prefix);
+
+      break;
+
+    case glob::shape::suffix: {
+      auto lit = std::string_view{ g.m_suffix };
+
+      if (lit.starts_with('.') && lit.find('.', 1) == std::string_view::npos)
+        m_extensions.insert(lit.substr(1));
+      else
+        table_of(m_suffixes, lit.size()).insert(lit);
+
+      break;
+    }
+
+    case glob::shape::contains:
+    case glob::shape::general:
+      break;
+    }
+  }
+
+  auto match(std::string_view name) const noexcept -> bool {
+    char buf[max_literal];
+
+    if (!m_extensions.empty()) {
+      auto dot = name.rfind('.');
+
+      if (dot != std::string_view::npos && name.size() - dot - 1 <= max_literal
+        && m_extensions.contains(folded(name.substr(dot + 1), buf)))
+        return true;
+    }
+
+    if (!m_exact.empty() && name.size() <= max_literal && m_exact.contains(folded(name, buf)))
+      return true;
+
+    // fold once the widest end any table looks at, the narrower are in it
+
+    if (!m_prefixes.empty()) {
+      auto head = folded(name.substr(0, std::min(name.size(), m_prefixes.back().size)), buf);
+
+      for (auto& t : m_prefixes)
+        if (t.size <= head.size() && t.literals.contains(head.substr(0, t.size)))
+          return true;
+    }
+
+    if (!m_suffixes.empty()) {
+      auto n = std::min(name.size(), m_suffixes.back().size);
+
+      auto tail = folded(name.substr(name.size() - n), buf);
+
+      for (auto& t : m_suffixes)
+        if (t.size <= tail.size() && t.literals.contains(tail.substr(tail.size() - t.size)))
+          return true;
+    }
+
+    return false;
+  }
+
+private:
+
+  // open addressing over the indices of the literals, kept at most half
+  // full; names are short, FNV-1a is as good a hash as any for them
+
+  struct literal_set {
+
+  public:
+
+    auto empty() const noexcept -> bool { return m_values.empty(); }
+
+    void insert(std::string_view s) {
+      if (contains(s))
+        return;
+
+      m_values.emplace_back(s);
+
+      if (m_values.size() * 2 > m_slots.size())
+        rehash(std::max<std::size_t>(16, m_slots.size() * 2));
+      else
+        place(m_values.size() - 1);
+    }
+
+    auto contains(std::string_view s) const noexcept -> bool {
+      if (m_slots.empty())
+        return false;
+
+      auto mask = m_slots.size() - 1;
+
+      for (auto i = hash(s) & mask; m_slots[i] != 0; i = (i + 1) & mask)
+        if (m_values[m_slots[i] - 1] == s)
+          return true;
+
+      return false;
+    }
+
+  private:
+
+    static auto hash(std::string_view s) noexcept -> std::size_t {
+      auto h = std::uint64_t{ 14695981039346656037u };
+
+      for (auto c : s)
+        h = (h ^ static_cast<unsigned char>(c)) * 1099511628211u;
+
+      return static_cast<std::size_t>(h ^ (h >> 32));
+    }
+
+    void rehash(std::size_t n) {
+      m_slots.assign(n, 0);
+
+      for (std::size_t i = 0; i < m_values.size(); ++i)
+        place(i);
+    }
+
+    void place(std::size_t index) {
+      auto mask = m_slots.size() - 1;
+
+      auto i = hash(m_values[index]) & mask;
+
+      while (m_slots[i] != 0)
+        i = (i + 1) & mask;
+
+      m_slots[i] = static_cast<std::uint32_t>(index + 1);
+    }
+
+    std::vector<std::string> m_values;
+
+    std::vector<std::uint32_t> m_slots; // 1 + the index of a value, or 0
+  };
+
+  // the literals of one size
+
+  struct table {
+    std::size_t size;
+
+    literal_set literals;
+  };
+
+  // the table for literals of the given size, tables kept by size
+
+  static auto table_of(std::vector<table>& tables, std::size_t size) -> literal_set& {
+    auto it = std::ranges::lower_bound(tables, size, {}, &table::size);
+
+    if (it == tables.end() || it->size != size)
+      it = tables.insert(it, table{ size, {} });
+
+    return it->literals;
+  }
+
+  // s as the literals were stored, folded into buf when ignoring case; s
+  // fits in buf
+
+  auto folded(std::string_view s, char* buf) const noexcept -> std::string_view {
+    if (!m_icase)
+      return s;
+
+    for (std::size_t i = 0; i < s.size(); ++i)
+      buf[i] = static_cast<char>(glob::lower(static_cast<unsigned char>(s[i])));
+
+    return { buf, s.size() };
+  }
+
+  literal_set m_extensions;
+
+  literal_set m_exact;
+
+  std::vector<table> m_prefixes;
+
+  std::vector<table> m_suffixes;
+
+  bool m_icase;
+};
+
+// bump allocation out of 64 KiB blocks, for small objects created by one
+// thread and released by any: every worker carves from a block of its own,
+// and a block goes back to a shared free list as a whole once everything
+// carved from it has been released, so that the walk stops touching the
+// heap once warmed up. Blocks are aligned on their size, which lets an
+// allocation find its block by masking its address.
+
+struct arena {
+
+private:
+
+  struct block;
+
+public:
+
+  static constexpr std::size_t block_size = 64 * 1024;
+
+  // the blocks shared by a group of arenas, it must outlive them
+
+  struct pool {
+
+  public:
+
+    pool() = default;
+
+    pool(const pool&) = delete;
+
+    pool& operator=(const pool&) = delete;
+
+    ~pool() {
+      while (m_free)
+        free_block(std::exchange(m_free, m_free->next));
+    }
+
+  private:
+
+    friend arena;
+
+    std::mutex m_mtx;
+
+    block* m_free = nullptr;
+  };
+
+  explicit arena(pool& pool) noexcept : m_pool{ &pool } {}
+
+  arena(arena&& o) noexcept
+    : m_pool{ o.m_pool }
+    , m_block{ std::exchange(o.m_block, nullptr) }
+    , m_top{ o.m_top }
+    , m_end{ o.m_end }
+  {
+  }
+
+  arena(const arena&) = delete;
+
+  arena& operator=(const arena&) = delete;
+
+  ~arena() {
+    if (m_block)
+      drop(m_block);
+  }
+
+  auto allocate(std::size_t bytes) -> void* {
+    bytes = (bytes + align - 1) & ~(align - 1);
+
+    // too big to share a block, give it one of its own
+
+    if (header_size + bytes > block_size) {
+      auto* b = new_block(m_pool, (header_size + bytes + block_size - 1) & ~(block_size - 1));
+
+      b->live.store(1, std::memory_order_relaxed);
+
+      return data(b);
+    }
+
+    if (!m_block || bytes > static_cast<std::size_t>(m_end - m_top))
+      refill();
+
+    auto* p = m_top;
+
+    m_top += bytes;
+
+    m_block->live.fetch_add(1, std::memory_order_relaxed);
+
+    return p;
+  }
+
+  // give back what allocate() returned, from any thread
+
+  static void release(void* p) noexcept {
+    drop(reinterpret_cast<block*>(reinterpret_cast<std::uintptr_t>(p) & ~(block_size - 1)));
+  }
+
+private:
+
+  struct block {
+    pool* owner;
+    std::atomic<std::size_t> live;
+    std::size_t size;
+    block* next;
+  };
+
+  static constexpr std::size_t align = alignof(std::max_align_t);
+
+  static constexpr std::size_t header_size = (sizeof(block) + align - 1) & ~(align - 1);
+
+  static inline auto data(block* b) noexcept -> char* { return reinterpret_cast<char*>(b) + header_size; }
+
+  static auto new_block(pool* owner, std::size_t size) -> block* {
+    stats::add(stats::allocs);
+    stats::add(stats::alloc_bytes, size);
+
+    auto* mem = ::operator new(size, std::align_val_t{ block_size });
+
+    return ::new (mem) block{ owner, 0, size, nullptr };
+  }
+
+  static void free_block(block* b) noexcept {
+    b->~block();
+
+    ::operator delete(static_cast<void*>(b), std::align_val_t{ block_size });
+  }
+
+  // the block we carve from holds a reference on itself until we move on
+
+  void refill() {
+    if (m_block)
+      drop(m_block);
+
+    {
+      std::lock_guard guard{ m_pool->m_mtx };
+
+      m_block = m_pool->m_free;
+
+      if (m_block)
+        m_pool->m_free = m_block->next;
+    }
+
+    if (!m_block)
+      m_block = new_block(m_pool, block_size);
+
+    m_block->live.store(1, std::memory_order_relaxed);
+
+    m_top = data(m_block);
+    m_end = reinterpret_cast<char*>(m_block) + block_size;
+  }
+
+  static void drop(block* b) noexcept {
+    if (b->live.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+
+    if (b->size != block_size)
+      return free_block(b);
+
+    std::lock_guard guard{ b->owner->m_mtx };
+
+    b->next = std::exchange(b->owner->m_free, b);
+  }
+
+  pool* m_pool;
+
+  block* m_block = nullptr;
+
+  char* m_top = nullptr;
+
+  char* m_end = nullptr;
+};
+
+#if defined(__linux__)
+
+// how many directory descriptors the walk may keep open at once, so that
+// their subdirectories are opened relative to them rather than by resolving
+// their whole path again; past it directories are opened by path. This is a
+// share of RLIMIT_NOFILE, as descriptors are a per-process resource.
+
+struct fd_budget {
+
+public:
+
+  fd_budget() noexcept {
+    auto rl = rlimit{};
+
+    auto limit = ::getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+      ? static_cast<long>(rl.rlim_cur)
+      : 1024L;
+
+    m_left = std::clamp(limit / 2 - reserve, 0L, 1L << 20);
+  }
+
+  inline auto acquire() noexcept -> bool {
+    if (m_left.fetch_sub(1, std::memory_order_relaxed) > 0)
+      return true;
+
+    m_left.fetch_add(1, std::memory_order_relaxed);
+
+    return false;
+  }
+
+  inline void release() noexcept { m_left.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+
+  // left for stdout, the transient descriptor each worker lists with and
+  // whatever else the process has open
+
+  static constexpr long reserve = 64;
+
+  std::atomic<long> m_left;
+};
+
+#endif
+
+// a directory waiting to be listed, allocated from an arena together with
+// its full path. It is referenced by its job and, once listed, by each of
+// its subdirectories that is still to be opened relative to its descriptor.
+
+struct dir_node {
+
+public:
+
+  // the node for dir joined with name, or for dir alone if name is empty,
+  // depth levels below the root
+
+  static auto make(arena& arena, std::string_view dir, std::string_view name, dir_node* parent, std::size_t depth) -> dir_node* {
+    auto sep = !name.empty() && !dir.ends_with('/');
+
+    auto size = dir.size() + sep + name.size();
+
+    auto* node = ::new (arena.allocate(sizeof(dir_node) + size + 1)) dir_node{ parent, size, depth };
+
+    auto* p = node->data();
+
+    std::memcpy(p, dir.data(), dir.size());
+
+    if (sep)
+      p[dir.size()] = '/';
+
+    if (!name.empty())
+      std::memcpy(p + dir.size() + sep, name.data(), name.size());
+
+    p[size] = '\0';
+
+    node->m_name_at = static_cast<std::uint32_t>(name.empty() ? node->path().find_last_of('/') + 1 : size - name.size());
+
+    return node;
+  }
+
+  inline auto path() const noexcept -> std::string_view { return { data(), m_size }; }
+
+  inline auto c_str() const noexcept -> const char* { return data(); }
+
+  // the last path component, NUL-terminated
+
+  inline auto name() const noexcept -> const char* { return data() + m_name_at; }
+
+  inline auto parent() const noexcept -> const dir_node* { return m_parent; }
+
+  inline auto depth() const noexcept -> std::size_t { return m_depth; }
+
+  // the device the node is on, 0 where it is not known, and the lane of
+  // the pool its listing counts against
+
+  inline auto dev() const noexcept -> std::uint64_t { return m_dev; }
+
+  inline auto lane() const noexcept -> std::size_t { return m_lane; }
+
+  inline void place(std::uint64_t dev, std::size_t lane) noexcept {
+    m_dev = dev;
+    m_lane = static_cast<std::uint16_t>(lane);
+  }
+
+  // with -delete, have the node removed once done with: once listed and
+  // once every subdirectory of it to remove is. Until then it holds on to
+  // up, the node of the directory it is in, to be removed relative to its
+  // descriptor.
+
+  inline void remove_later(dir_node* up) noexcept {
+    m_remove = true;
+    m_waiting.store(1, std::memory_order_relaxed);
+
+    if (!up)
+      return;
+
+    up->ref();
+
+    if (up->m_remove)
+      up->m_waiting.fetch_add(1, std::memory_order_relaxed);
+
+    m_up = up;
+  }
+
+  inline auto removing() const noexcept -> bool { return m_remove; }
+
+  // one of what the removal waits for is done with, its listing or a
+  // subdirectory, walked or not: true for the last one. It is then spared
+  // if any was not walked.
+
+  inline auto settle(bool walked) noexcept -> bool {
+    if (!walked)
+      m_spared.store(true, std::memory_order_relaxed);
+
+    return m_waiting.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+  inline auto spared() const noexcept -> bool { return m_spared.load(std::memory_order_relaxed); }
+
+  // remove the directory, relative to up when that one is open still, and
+  // otherwise by its path
+
+  auto remove() noexcept -> bool {
+#if defined(__linux__)
+    auto at = m_up && m_up->fd() >= 0;
+
+    return ::unlinkat(at ? m_up->fd() : AT_FDCWD, at ? name() : c_str(), AT_REMOVEDIR) == 0;
+#else
+    auto ec = std::error_code{};
+
+    return fs::remove(fs::path{ path() }, ec) && !ec;
+#endif
+  }
+
+  inline auto take_up() noexcept -> dir_node* { return std::exchange(m_up, nullptr); }
+
+  // once opened the node has no use for its parent anymore
+
+  inline void drop_parent() noexcept {
+    if (m_parent)
+      unref(std::exchange(m_parent, nullptr));
+  }
+
+  inline void ref() noexcept { m_refs.fetch_add(1, std::memory_order_relaxed); }
+
+  static void unref(dir_node* node) noexcept {
+    if (node->m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+
+    node->drop_parent();
+
+    if (node->m_up)
+      unref(node->take_up());
+
+#if defined(__linux__)
+    if (node->m_fd >= 0) {
+      ::close(node->m_fd);
+
+      budget.release();
+    }
+#endif
+
+    node->~dir_node();
+
+    arena::release(node);
+  }
+
+#if defined(__linux__)
+
+  inline auto fd() const noexcept -> int { return m_fd; }
+
+  // hold on to the descriptor the node was opened with, for its children,
+  // if the budget allows it
+
+  inline auto keep(int fd) noexcept -> bool {
+    if (!budget.acquire())
+      return false;
+
+    m_fd = fd;
+
+    return true;
+  }
+
+  // a descriptor opened before the node is listed takes from the budget
+  // too: reserve() before opening it, then either adopt() it or give the
+  // reservation back with unreserve()
+
+  static inline auto reserve() noexcept -> bool { return budget.acquire(); }
+
+  static inline void unreserve() noexcept { budget.release(); }
+
+  inline void adopt(int fd) noexcept { m_fd = fd; }
+
+#endif
+
+private:
+
+  dir_node(dir_node* parent, std::size_t size, std::size_t depth) noexcept
+    : m_parent{ parent }
+    , m_size{ static_cast<std::uint32_t>(size) }
+    , m_depth{ static_cast<std::uint32_t>(depth) }
+  {
+  }
+
+  inline auto data() const noexcept -> char* { return const_cast<char*>(reinterpret_cast<const char*>(this + 1)); }
+
+  dir_node* m_parent;
+
+  std::atomic<std::uint32_t> m_refs{ 1 };
+
+  std::uint32_t m_size;
+
+  std::uint32_t m_name_at = 0;
+
+  std::uint32_t m_depth;
+
+  std::uint16_t m_lane = 0;
+
+  bool m_remove = false;
+
+  std::atomic<bool> m_spared{ false };
+
+  std::atomic<std::uint32_t> m_waiting{ 0 };
+
+  std::uint64_t m_dev = 0;
+
+  dir_node* m_up = nullptr;
+
+#if defined(__linux__)
+
+  int m_fd = -1;
+
+  static inline fd_budget budget{};
+
+#endif
+};
+
+// what has to be known of an entry to evaluate a predicate on it, from the
+// cheapest: its name, its type (free whenever the listing tells it) or the
+// whole of its metadata
+
+enum class meta_need : std::uint8_t {
+  name,
+  type,
+  stat,
+};
+
+// the fields of file_meta, as bits, so that the stat of an entry asks for
+// those that are going to be read only
+
+struct meta_field {
+  enum bits : std::uint32_t {
+    type = 1 << 0,
+    perms = 1 << 1,
+    size = 1 << 2,
+    mtime = 1 << 3,
+    dev = 1 << 4,
+    ino = 1 << 5,
+    uid = 1 << 6,
+    gid = 1 << 7,
+    nlink = 1 << 8,
+
+    all = (1 << 9) - 1,
+  };
+};
+
+// how an entry is to be fetched: at which level and, at meta_need::stat,
+// which fields. dont_sync lets a network filesystem answer from what it has
+// cached instead of asking the server again, follow has symlinks answer for
+// what they point to (but for those pointing nowhere).
+
+struct meta_hint {
+  meta_need need = meta_need::name;
+  std::uint32_t fields = 0;
+  bool dont_sync = false;
+  bool follow = false;
+
+  constexpr meta_hint() noexcept = default;
+
+  constexpr meta_hint(meta_need need, std::uint32_t fields) noexcept : need{ need }, fields{ fields } {}
+
+  // every field the level tells
+
+  constexpr meta_hint(meta_need need) noexcept
+    : need{ need }
+    , fields{ need == meta_need::stat ? meta_field::all : need == meta_need::type ? meta_field::type : 0u }
+  {
+  }
+};
+
+struct file_meta {
+  fs::file_type type = fs::file_type::unknown;
+  fs::perms perms = fs::perms::unknown;
+  std::uint64_t size = 0;
+  std::int64_t mtime = 0; // ns since the epoch
+  std::uint64_t dev = 0;
+  std::uint64_t ino = 0;
+  std::uint32_t uid = 0;
+  std::uint32_t gid = 0;
+  std::uint64_t nlink = 0;
+};
+
+// an entry met while listing a directory: the path of that directory, its
+// name there and whatever metadata the listing came with. The rest is only
+// fetched when asked for, once, and straight at the hinted level when a
+// cheaper one would not be enough anyway for what is going to be asked.
+
+struct dir_entry {
+
+public:
+
+  std::string_view dir;
+
+  std::string_view name;
+
+  inline auto type() const noexcept -> fs::file_type {
+    if (m_level < meta_need::type)
+      fetch(std::max(meta_need::type, m_hint.need));
+
+    return m_meta.type;
+  }
+
+  inline auto meta() const noexcept -> const file_meta& {
+    if (m_level < meta_need::stat)
+      fetch(meta_need::stat);
+
+    return m_meta;
+  }
+
+  // whether asking for what level tells costs nothing anymore
+
+  inline auto known(meta_need level) const noexcept -> bool { return m_level >= level; }
+
+  // remove the entry, a directory only if it is empty; false if it could
+  // not be
+
+  auto remove(bool directory) const noexcept -> bool {
+#if defined(__linux__)
+    return ::unlinkat(m_at, m_path, directory ? AT_REMOVEDIR : 0) == 0;
+#else
+    auto ec = std::error_code{};
+
+    return fs::remove(m_entry->path(), ec) && !ec;
+#endif
+  }
+
+#if defined(__linux__)
+
+  // where the entry is relative to the descriptor at, path being
+  // NUL-terminated, and its type if known already
+
+  dir_entry(std::string_view dir, std::string_view name, int at, const char* path, fs::file_type type, meta_hint hint) noexcept
+    : dir{ dir }
+    , name{ name }
+    , m_hint{ hint }
+    , m_level{ type == fs::file_type::unknown || (hint.follow && type == fs::file_type::symlink) ? meta_need::name : meta_need::type }
+    , m_at{ at }
+    , m_path{ path }
+  {
+    m_meta.type = type;
+  }
+
+  // the same with the metadata statx(2) found already, as much of it as
+  // level tells
+
+  dir_entry(std::string_view dir, std::string_view name, int at, const char* path, const struct statx& stx, meta_need level, meta_hint hint) noexcept
+    : dir{ dir }
+    , name{ name }
+    , m_hint{ hint }
+    , m_level{ level }
+    , m_meta{ meta_of(stx) }
+    , m_at{ at }
+    , m_path{ path }
+  {
+  }
+
+#else
+
+  dir_entry(std::string_view dir, std::string_view name, const fs::directory_entry& entry, meta_hint hint) noexcept
+    : dir{ dir }
+    , name{ name }
+    , m_hint{ hint }
+    , m_entry{ &entry }
+  {
+  }
+
+#endif
+
+private:
+
+#if defined(__linux__)
+
+  static auto type_of(mode_t mode) noexcept -> fs::file_type {
+    switch (mode & S_IFMT) {
+
+    case S_IFDIR: return fs::file_type::directory;
+    case S_IFREG: return fs::file_type::regular;
+    case S_IFLNK: return fs::file_type::symlink;
+    case S_IFBLK: return fs::file_type::block;
+    case S_IFCHR: return fs::file_type::character;
+    case S_IFIFO: return fs::file_type::fifo;
+    case S_IFSOCK: return fs::file_type::socket;
+
+    }
+
+    return fs::file_type::unknown;
+  }
+
+  // only the fields stx_mask tells are taken, the others stay unknown or
+  // zero: those not asked for are not filled in, and a filesystem may not
+  // have some of those that are
+
+  static auto meta_of(const struct statx& stx) noexcept -> file_meta {
+    auto meta = file_meta{ .dev = makedev(stx.stx_dev_major, stx.stx_dev_minor) };
+
+    auto has = [&](unsigned bit) { return (stx.stx_mask & bit) != 0; };
+
+    if (has(STATX_TYPE))
+      meta.type = type_of(stx.stx_mode);
+
+    if (has(STATX_MODE))
+      meta.perms = static_cast<fs::perms>(stx.stx_mode & 07777);
+
+    if (has(STATX_SIZE))
+      meta.size = stx.stx_size;
+
+    if (has(STATX_MTIME))
+      meta.mtime = stx.stx_mtime.tv_sec * 1'000'000'000LL + stx.stx_mtime.tv_nsec;
+
+    if (has(STATX_INO))
+      meta.ino = stx.stx_ino;
+
+    if (has(STATX_UID))
+      meta.uid = stx.stx_uid;
+
+    if (has(STATX_GID))
+      meta.gid = stx.stx_gid;
+
+    if (has(STATX_NLINK))
+      meta.nlink = stx.stx_nlink;
+
+    return meta;
+  }
+
+public:
+
+  // the statx(2) mask for the fields of meta_field, the device coming with
+  // every answer
+
+  static constexpr auto mask_of(std::uint32_t fields) noexcept -> unsigned {
+    auto mask = 0u;
+
+    if (fields & meta_field::type)
+      mask |= STATX_TYPE;
+
+    if (fields & meta_field::perms)
+      mask |= STATX_MODE;
+
+    if (fields & meta_field::size)
+      mask |= STATX_SIZE;
+
+    if (fields & meta_field::mtime)
+      mask |= STATX_MTIME;
+
+    if (fields & meta_field::ino)
+      mask |= STATX_INO;
+
+    if (fields & meta_field::uid)
+      mask |= STATX_UID;
+
+    if (fields & meta_field::gid)
+      mask |= STATX_GID;
+
+    if (fields & meta_field::nlink)
+      mask |= STATX_NLINK;
+
+    return mask;
+  }
+
+  static constexpr auto flags_of(const meta_hint& hint) noexcept -> int {
+    return (hint.follow ? 0 : AT_SYMLINK_NOFOLLOW) | (hint.dont_sync ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT);
+  }
+
+private:
+
+  // a failure still counts as fetched, the entry may well be gone by now.
+  // Only the type, or the fields of the hint, are asked for.
+
+  void fetch(meta_need need) const noexcept {
+    m_level = need;
+
+    struct statx stx{};
+
+    stats::add(stats::stat_calls);
+
+    auto fields = need == meta_need::stat ? m_hint.fields | meta_field::type : meta_field::type;
+
+    // a symlink pointing nowhere is one when followed too
+
+    auto flags = flags_of(m_hint);
+
+    auto stat = [&](int flags) { return stats::timed([&]() { return ::statx(m_at, m_path, flags, mask_of(fields), &stx); }); };
+
+    if (stat(flags) != 0 && (!m_hint.follow || stat(flags | AT_SYMLINK_NOFOLLOW) != 0))
+      return;
+
+    m_meta = meta_of(stx);
+  }
+
+#else
+
+  void fetch(meta_need need) const noexcept {
+    auto ec = std::error_code{};
+
+    stats::add(stats::stat_calls);
+
+    auto status = m_entry->symlink_status(ec);
+
+    m_meta.type = status.type();
+    m_meta.perms = status.permissions();
+
+    m_level = meta_need::type;
+
+    if (need < meta_need::stat)
+      return;
+
+    // the rest is all or nothing through std::filesystem
+
+    m_level = meta_need::stat;
+
+    if (m_meta.type == fs::file_type::regular)
+      m_meta.size = m_entry->file_size(ec);
+
+    auto mtime = m_entry->last_write_time(ec);
+
+    if (!ec)
+      m_meta.mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::clock_cast<std::chrono::system_clock>(mtime).time_since_epoch()).count();
+  }
+
+#endif
+
+  meta_hint m_hint;
+
+  mutable meta_need m_level = meta_need::name;
+
+  mutable file_meta m_meta;
+
+#if defined(__linux__)
+
+  int m_at;
+
+  const char* m_path;
+
+#else
+
+  const fs::directory_entry* m_entry;
+
+#endif
+};
+
+// how reading a directory went: gone is for one that is no directory
+// anymore by the time it is opened, swapped for a symlink most likely,
+// which is then neither listed nor an error
+
+enum class listing_of : std::uint8_t {
+  listed,
+  failed,
+  gone,
+};
+
+#if defined(__linux__)
+
+#if defined(FIND_IO_URING)
+
+// a small io_uring, set up straight with the system calls: requests are
+// prepared into the submission ring and many of them are in flight at once,
+// for the blocking round trips of network filesystems to overlap
+
+struct uring {
+
+public:
+
+  // nullptr where io_uring is missing or not allowed
+
+  static auto make(unsigned entries) noexcept -> std::unique_ptr<uring> {
+    auto p = io_uring_params{};
+
+    auto fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+
+    if (fd < 0)
+      return {};
+
+    auto ring = std::unique_ptr<uring>{ new uring{ fd } };
+
+    return ring->map(p) ? std::move(ring) : nullptr;
+  }
+
+  uring(const uring&) = delete;
+
+  uring& operator=(const uring&) = delete;
+
+  ~uring() {
+    if (m_sqes != MAP_FAILED)
+      ::munmap(m_sqes, m_sqes_size);
+
+    if (m_cq != MAP_FAILED && m_cq != m_sq)
+      ::munmap(m_cq, m_cq_size);
+
+    if (m_sq != MAP_FAILED)
+      ::munmap(m_sq, m_sq_size);
+
+    ::close(m_fd);
+  }
+
+  // run n requests, prep(sqe, i) filling in the i-th and done(i, res) told
+  // how it went, res being what the system call would have returned or
+  // -errno; all n are done on return
+
+  void run(std::size_t n, auto&& prep, auto&& done) {
+    std::size_t next = 0, in_flight = 0, queued = 0;
+
+    while (next < n || in_flight > 0) {
+      for (; next < n && in_flight < m_entries; ++next, ++in_flight, ++queued) {
+        auto tail = *m_sq_tail;
+
+        auto& sqe = m_sqes[tail & *m_sq_mask];
+
+        sqe = io_uring_sqe{};
+        sqe.user_data = next;
+
+        prep(sqe, next);
+
+        std::atomic_ref{ *m_sq_tail }.store(tail + 1, std::memory_order_release);
+      }
+
+      auto res = stats::timed([&]() { return ::syscall(__NR_io_uring_enter, m_fd, queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0); });
+
+      auto error = res < 0 ? errno : 0;
+
+      if (res < 0 && error != EINTR && error != EAGAIN && error != EBUSY) {
+        // the ring is unusable. The last queued requests were not taken:
+        // they fail right away, off the ring for no later call to submit
+        // them, as do those not prepared yet. Only those the kernel took
+        // are waited for, they complete whether entered again or not.
+
+        std::atomic_ref{ *m_sq_tail }.store(*m_sq_tail - static_cast<std::uint32_t>(queued), std::memory_order_release);
+
+        for (auto i = next - queued; i < next; ++i)
+          done(i, -error);
+
+        in_flight -= queued;
+
+        for (; next < n; ++next)
+          done(next, -error);
+
+        while (in_flight > 0) {
+          reap([&](std::size_t i, int r) { done(i, r); --in_flight; });
+
+          if (in_flight > 0)
+            std::this_thread::yield();
+        }
+
+        return;
+      }
+
+      if (res > 0)
+        queued -= static_cast<std::size_t>(res);
+
+      reap([&](std::size_t i, int r) { done(i, r); --in_flight; });
+    }
+  }
+
+private:
+
+  explicit uring(int fd) noexcept : m_fd{ fd } {}
+
+  auto map(const io_uring_params& p) noexcept -> bool {
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(std::uint32_t);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+
+    auto single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+    if (single)
+      m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+
+    m_sq = ::mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+
+    if (m_sq == MAP_FAILED)
+      return false;
+
+    m_cq = single
+      ? m_sq
+      : ::mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+
+    auto sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+
+    if (m_cq == MAP_FAILED || sqes == MAP_FAILED)
+      return false;
+
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    auto* sq = static_cast<char*>(m_sq);
+    auto* cq = static_cast<char*>(m_cq);
+
+    m_sq_tail = reinterpret_cast<std::uint32_t*>(sq + p.sq_off.tail);
+    m_sq_mask = reinterpret_cast<std::uint32_t*>(sq + p.sq_off.ring_mask);
+    m_cq_head = reinterpret_cast<std::uint32_t*>(cq + p.cq_off.head);
+    m_cq_tail = reinterpret_cast<std::uint32_t*>(cq + p.cq_off.tail);
+    m_cq_mask = reinterpret_cast<std::uint32_t*>(cq + p.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    // every slot of the submission ring stands for the entry of its index
+
+    auto* array = reinterpret_cast<std::uint32_t*>(sq + p.sq_off.array);
+
+    for (std::uint32_t i = 0; i < p.sq_entries; ++i)
+      array[i] = i;
+
+    m_entries = p.sq_entries;
+
+    return true;
+  }
+
+  void reap(auto&& fn) {
+    auto head = *m_cq_head;
+
+    auto tail = std::atomic_ref{ *m_cq_tail }.load(std::memory_order_acquire);
+
+    for (; head != tail; ++head) {
+      auto& cqe = m_cqes[head & *m_cq_mask];
+
+      fn(static_cast<std::size_t>(cqe.user_data), cqe.res);
+    }
+
+    std::atomic_ref{ *m_cq_head }.store(head, std::memory_order_release);
+  }
+
+  int m_fd;
+
+  void* m_sq = MAP_FAILED;
+
+  void* m_cq = MAP_FAILED;
+
+  io_uring_sqe* m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+
+  std::size_t m_sq_size = 0;
+
+  std::size_t m_cq_size = 0;
+
+  std::size_t m_sqes_size = 0;
+
+  std::uint32_t* m_sq_tail = nullptr;
+
+  std::uint32_t* m_sq_mask = nullptr;
+
+  std::uint32_t* m_cq_head = nullptr;
+
+  std::uint32_t* m_cq_tail = nullptr;
+
+  std::uint32_t* m_cq_mask = nullptr;
+
+  io_uring_cqe* m_cqes = nullptr;
+
+  std::size_t m_entries = 0;
+};
+
+#else
+
+// only ever absent
+
+struct uring {};
+
+#endif
+
+// directory listing straight from getdents64(2) into a large buffer: types
+// come from d_type, so only the entries of filesystems not filling it cost
+// an fstatat(2), and a directory takes an open, a couple of getdents64 and a
+// close no matter how many entries it has. With io_uring the stats of each
+// buffer go out together, and so do the opens of the directories found in
+// it once it is listed; there is no getdents64 for io_uring to do, that one
+// stays a plain system call.
+
+struct dir_reader {
+
+public:
+
+  static constexpr std::size_t buffer_size = 64 * 1024;
+
+  // requests in flight at once on the ring of a reader
+
+  static constexpr unsigned ring_size = 64;
+
+  // with io_uring only if the kernel lets it be set up, the plain system
+  // calls otherwise
+
+  explicit dir_reader(meta_hint hint, bool io_uring = false)
+    : m_hint{ hint }
+    , m_buf{ std::make_unique_for_overwrite<char[]>(buffer_size) }
+#if defined(FIND_IO_URING)
+    , m_ring{ io_uring ? uring::make(ring_size) : nullptr }
+#endif
+  {
+    (void)io_uring;
+  }
+
+  inline auto batched() const noexcept -> bool { return m_ring != nullptr; }
+
+  // call fn(entry) for the directory at path the walk starts from, whose
+  // dir is what comes before name in path
+
+  void top(const fs::path& path, std::string_view name, auto&& fn) {
+    auto dir = std::string_view{ path.native() };
+
+    dir.remove_suffix(name.size());
+
+    stats::add(stats::entries);
+
+    fn(dir_entry{ dir, name, AT_FDCWD, path.c_str(), fs::file_type::directory, m_hint });
+  }
+
+  // open the directory of node, relative to its parent when that one is
+  // still open, and call fn(entry, share) for every entry but "." and "..".
+  // share() returns node with a new reference for its children to be opened
+  // relative to it, or nullptr. Symlinks are only opened through with -L.
+
+  auto read(dir_node& node, auto&& fn) -> listing_of {
+    return read(node, fn, [](const dir_entry&) { return true; });
+  }
+
+  // the same, the entries the hint asks to be stated and wants(entry) is
+  // true for stated together, in inode order, before fn is called on any
+  // of the same buffer
+
+  auto read(dir_node& node, auto&& fn, auto&& wants) -> listing_of {
+    return read(node, fn, wants, []() {});
+  }
+
+  // the same, calling done() once fn is through the entries of a buffer:
+  // their names are in it, and so only valid until then
+
+  auto read(dir_node& node, auto&& fn, auto&& wants, auto&& done) -> listing_of {
+    auto* parent = node.parent();
+
+    auto opened = node.fd() >= 0;
+
+    auto fd = opened
+      ? node.fd()
+      : stats::timed([&]() { return parent ? ::openat(parent->fd(), node.name(), flags()) : ::open(node.c_str(), flags()); });
+
+    auto error = fd < 0 ? errno : 0;
+
+    node.drop_parent();
+
+    if (fd < 0)
+      return error == ELOOP || error == ENOTDIR ? listing_of::gone : listing_of::failed;
+
+    if (!opened)
+      stats::add(stats::dirs_opened);
+
+    // open() ahead of time, the node holds on to it already
+
+    auto tried = opened;
+
+    auto share = [&]() -> dir_node* {
+      if (!std::exchange(tried, true))
+        node.keep(fd);
+
+      if (node.fd() < 0)
+        return nullptr;
+
+      node.ref();
+
+      return &node;
+    };
+
+    auto dir = node.path();
+
+    while (true) {
+      auto n = stats::timed([&]() { return ::syscall(SYS_getdents64, fd, m_buf.get(), buffer_size); });
+
+      stats::add(stats::getdents_calls);
+
+      if (n <= 0)
+        break;
+
+      if (m_hint.need == meta_need::stat || (m_ring && m_hint.need == meta_need::type)) {
+        list_batched(dir, fd, n, fn, share, wants);
+
+        done();
+
+        continue;
+      }
+
+      for (long off = 0; off < n;) {
+        auto* d = reinterpret_cast<const dirent64*>(m_buf.get() + off);
+
+        off += d->d_reclen;
+
+        auto name = std::string_view{ d->d_name };
+
+        if (name == "." || name == "..")
+          continue;
+
+        stats::add(stats::entries);
+
+        fn(dir_entry{ dir, name, fd, d->d_name, type_of(d->d_type), m_hint }, share);
+      }
+
+      done();
+    }
+
+    // kept or not, the listing is done with it
+
+    if (node.fd() < 0)
+      ::close(fd);
+
+    return listing_of::listed;
+  }
+
+  // open the directories of nodes on the ring, each then listed through
+  // the descriptor it holds; those the budget has no room for, or that fail
+  // to open, are left to read() to open
+
+  void prefetch(auto&& nodes) {
+#if defined(FIND_IO_URING)
+    if (!m_ring)
+      return;
+
+    m_opening.clear();
+
+    for (dir_node* node : nodes) {
+      if (node->fd() >= 0 || !dir_node::reserve())
+        continue;
+
+      m_opening.push_back(node);
+    }
+
+    m_ring->run(m_opening.size(),
+      [&](io_uring_sqe& sqe, std::size_t i) {
+        auto* parent = m_opening[i]->parent();
+
+        sqe.opcode = IORING_OP_OPENAT;
+        sqe.fd = parent ? parent->fd() : AT_FDCWD;
+        sqe.addr = reinterpret_cast<std::uintptr_t>(parent ? m_opening[i]->name() : m_opening[i]->c_str());
+        sqe.open_flags = flags();
+      },
+      [&](std::size_t i, int res) {
+        if (res < 0)
+          return dir_node::unreserve();
+
+        stats::add(stats::dirs_opened);
+
+        m_opening[i]->adopt(res);
+      });
+#else
+    (void)nodes;
+#endif
+  }
+
+private:
+
+  // the type of a directory was told before it is opened: O_NOFOLLOW
+  // keeps one swapped for a symlink meanwhile from being walked into
+
+  inline auto flags() const noexcept -> int { return O_RDONLY | O_DIRECTORY | O_CLOEXEC | (m_hint.follow ? 0 : O_NOFOLLOW); }
+
+  // the n bytes of the buffer, with the type or the metadata of the
+  // entries that need it fetched at once before any of them is passed on
+
+  void list_batched(std::string_view dir, int fd, long n, auto&& fn, auto&& share, auto&& wants) {
+    m_listed.clear();
+    m_entries.clear();
+    m_wanted.clear();
+
+    for (long off = 0; off < n;) {
+      auto* d = reinterpret_cast<const dirent64*>(m_buf.get() + off);
+
+      off += d->d_reclen;
+
+      auto name = std::string_view{ d->d_name };
+
+      if (name == "." || name == "..")
+        continue;
+
+      m_listed.push_back(d);
+      m_entries.push_back(dir_entry{ dir, name, fd, d->d_name, type_of(d->d_type), m_hint });
+
+      auto untold = d->d_type == DT_UNKNOWN || (m_hint.follow && d->d_type == DT_LNK);
+
+      if ((m_hint.need == meta_need::stat || untold) && wants(m_entries.back()))
+        m_wanted.push_back(m_entries.size() - 1);
+    }
+
+    // inode numbers follow the inode tables on ext4 and xfs, those are
+    // read through in order rather than jumped around
+
+    std::ranges::sort(m_wanted, {}, [this](std::size_t i) { return m_listed[i]->d_ino; });
+
+    if (m_ring)
+      stat_batched(fd);
+    else
+      for (auto i : m_wanted)
+        m_entries[i].type();
+
+    for (auto& entry : m_entries) {
+      stats::add(stats::entries);
+
+      fn(entry, share);
+    }
+  }
+
+  // the entries of m_wanted stated on the ring; those that could not be
+  // are, lazily, as usual
+
+  void stat_batched(int fd) {
+#if defined(FIND_IO_URING)
+    auto level = m_hint.need == meta_need::stat ? meta_need::stat : meta_need::type;
+
+    auto mask = dir_entry::mask_of(level == meta_need::stat ? m_hint.fields | meta_field::type : meta_field::type);
+
+    m_statx.resize(m_wanted.size());
+
+    m_ring->run(m_wanted.size(),
+      [&](io_uring_sqe& sqe, std::size_t i) {
+        stats::add(stats::stat_calls);
+
+        m_statx[i].stx_mask = 0;
+
+        sqe.opcode = IORING_OP_STATX;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uintptr_t>(m_listed[m_wanted[i]]->d_name);
+        sqe.len = mask;
+        sqe.off = reinterpret_cast<std::uintptr_t>(&m_statx[i]);
+        sqe.statx_flags = dir_entry::flags_of(m_hint);
+      },
+      [&](std::size_t i, int res) {
+        if (res < 0 || (m_statx[i].stx_mask & mask) != mask)
+          return;
+
+        auto& e = m_entries[m_wanted[i]];
+
+        e = dir_entry{ e.dir, e.name, fd, m_listed[m_wanted[i]]->d_name, m_statx[i], level, m_hint };
+      });
+#else
+    (void)fd;
+#endif
+  }
+
+  static auto type_of(unsigned char d_type) noexcept -> fs::file_type {
+    switch (d_type) {
+
+    case DT_DIR: return fs::file_type::directory;
+    case DT_REG: return fs::file_type::regular;
+    case DT_LNK: return fs::file_type::symlink;
+    case DT_BLK: return fs::file_type::block;
+    case DT_CHR: return fs::file_type::character;
+    case DT_FIFO: return fs::file_type::fifo;
+    case DT_SOCK: return fs::file_type::socket;
+
+    }
+
+    return fs::file_type::unknown;
+  }
+
+  meta_hint m_hint;
+
+  std::unique_ptr<char[]> m_buf;
+
+  std::unique_ptr<uring> m_ring;
+
+  // what list_batched() and prefetch() work through
+
+  std::vector<const dirent64*> m_listed;
+
+  std::vector<dir_entry> m_entries;
+
+  std::vector<std::size_t> m_wanted;
+
+  std::vector<struct statx> m_statx;
+
+  std::vector<dir_node*> m_opening;
+};
+
+#else
+
+// portable listing through std::filesystem, symlinks are not followed
+
+struct dir_reader {
+
+public:
+
+  explicit dir_reader(meta_hint hint) : m_hint{ hint } {}
+
+  // there is no io_uring to batch with here
+
+  inline auto batched() const noexcept -> bool { return false; }
+
+  void prefetch(auto&&) noexcept {}
+
+
+  void top(const fs::path& path, std::string_view name, auto&& fn) {
+    auto ec = std::error_code{};
+
+    auto dir = std::string_view{ path.native() };
+
+    dir.remove_suffix(name.size());
+
+    stats::add(stats::entries);
+
+    fn(dir_entry{ dir, name, fs::directory_entry{ path, ec }, m_hint });
+  }
+
+  auto read(dir_node& node, auto&& fn) -> listing_of {
+    return read(node, fn, [](const dir_entry&) { return true; });
+  }
+
+  auto read(dir_node& node, auto&& fn, auto&& wants) -> listing_of {
+    return read(node, fn, wants, []() {});
+  }
+
+  // an entry refers to where the iterator is, so each is a buffer of its
+  // own for done(). There is no O_NOFOLLOW for the iterator, a directory
+  // swapped for a symlink is only caught when that happened before.
+
+  auto read(dir_node& node, auto&& fn, auto&&, auto&& done) -> listing_of {
+    auto share = []() -> dir_node* { return nullptr; };
+
+    node.drop_parent();
+
+    auto ec = std::error_code{};
+
+    if (!m_hint.follow && fs::symlink_status(fs::path{ node.path() }, ec).type() == fs::file_type::symlink)
+      return listing_of::gone;
+
+    auto it = fs::directory_iterator{ node.path(), fs::directory_options::skip_permission_denied, ec };
+
+    if (ec)
+      return ec == std::errc::not_a_directory ? listing_of::gone : listing_of::failed;
+
+    stats::add(stats::dirs_opened);
+
+    auto dir = node.path();
+
+    for (; it != fs::directory_iterator{}; it.increment(ec)) {
+      if (ec)
+        break;
+
+      auto& native = it->path().native();
+
+      auto name = std::string_view{ native }.substr(native.find_last_of(fs::path::preferred_separator) + 1);
+
+      stats::add(stats::entries);
+
+      fn(dir_entry{ dir, name, *it, m_hint }, share);
+
+      done();
+    }
+
+    return listing_of::listed;
+  }
+
+private:
+
+  meta_hint m_hint;
+};
+
+#endif
+
+#if defined(__linux__)
+
+// a locate-style database of the directories under a root, for --index and
+// --index-build: a header with the root, then one record per directory in
+// depth-first order with the entries of each by name. A record is its size,
+// the path of the directory front-compressed against the one before, its
+// mtime and its entries, each a type and a name. As a directory's mtime
+// changes whenever an entry is added, removed or renamed in it, a record
+// with the mtime the directory still has lists what the directory holds.
+
+struct path_index {
+
+public:
+
+  struct entry {
+    std::string_view name;
+    fs::file_type type;
+  };
+
+  // depth-first order of paths under one root, `/` sorting before any byte
+  // as paths there are entry names joined by it
+
+  static auto dfs_less(std::string_view a, std::string_view b) noexcept -> bool {
+    auto key = [](char c) { return c == '/' ? 0u : static_cast<unsigned char>(c) + 1u; };
+
+    auto n = std::min(a.size(), b.size());
+
+    for (std::size_t i = 0; i < n; ++i)
+      if (a[i] != b[i])
+        return key(a[i]) < key(b[i]);
+
+    return a.size() < b.size();
+  }
+
+  // a database mapped read-only, whose records are looked up in the order
+  // they were written
+
+  struct reader {
+
+  public:
+
+    // nullopt when file is missing or is not a database
+
+    static auto open(const char* file) noexcept -> std::optional<reader> {
+      auto fd = ::open(file, O_RDONLY | O_CLOEXEC);
+
+      if (fd < 0)
+        return {};
+
+      struct stat st;
+
+      void* map = MAP_FAILED;
+
+      if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+      ::close(fd);
+
+      if (map == MAP_FAILED)
+        return {};
+
+      auto obj = std::optional<reader>{ std::in_place, static_cast<const char*>(map), static_cast<std::size_t>(st.st_size) };
+
+      auto root = obj->header();
+
+      if (!root)
+        return {};
+
+      obj->m_root = *root;
+
+      return obj;
+    }
+
+    reader(const char* data, std::size_t size) noexcept : m_data{ data }, m_size{ size } {}
+
+    reader(reader&& o) noexcept
+      : m_data{ std::exchange(o.m_data, nullptr) }
+      , m_size{ o.m_size }
+      , m_at{ o.m_at }
+      , m_root{ o.m_root }
+    {
+    }
+
+    reader(const reader&) = delete;
+
+    reader& operator=(const reader&) = delete;
+
+    reader& operator=(reader&&) = delete;
+
+    ~reader() {
+      if (m_data)
+        ::munmap(const_cast<char*>(m_data), m_size);
+    }
+
+    inline auto root() const noexcept -> std::string_view { return m_root; }
+
+    // move to the record of dir, passing those of the directories before it
+    // that were not asked for; false if there is none
+
+    auto seek(std::string_view dir) noexcept -> bool {
+      while (m_loaded || next()) {
+        if (m_path == dir)
+          return true;
+
+        if (!dfs_less(m_path, dir))
+          return false;
+
+        m_loaded = false;
+      }
+
+      return false;
+    }
+
+    inline auto mtime() const noexcept -> std::int64_t { return m_mtime; }
+
+    // call fn(entry) for every entry of the record seek moved to, false if
+    // the record turns out to be malformed
+
+    auto entries(auto&& fn) noexcept -> bool {
+      auto at = m_entries;
+
+      for (std::uint64_t i = 0; i < m_count; ++i) {
+        if (at >= m_end)
+          return false;
+
+        auto type = static_cast<fs::file_type>(static_cast<unsigned char>(m_data[at++]));
+
+        auto name = string(at, m_end);
+
+        if (!name)
+          return false;
+
+        fn(entry{ *name, type });
+      }
+
+      return true;
+    }
+
+  private:
+
+    auto varint(std::size_t& at, std::size_t end) const noexcept -> std::optional<std::uint64_t> {
+      auto res = std::uint64_t{ 0 };
+
+      for (unsigned shift = 0; at < end && shift < 64; shift += 7) {
+        auto b = static_cast<unsigned char>(m_data[at++]);
+
+        res |= std::uint64_t{ b & 0x7fu } << shift;
+
+        if (!(b & 0x80))
+          return res;
+      }
+
+      return {};
+    }
+
+    auto string(std::size_t& at, std::size_t end) const noexcept -> std::optional<std::string_view> {
+      auto n = varint(at, end);
+
+      if (!n || *n > end - at)
+        return {};
+
+      auto res = std::string_view{ m_data + at, static_cast<std::size_t>(*n) };
+
+      at += *n;
+
+      return res;
+    }
+
+    auto header() noexcept -> std::optional<std::string_view> {
+      if (m_size < magic.size() || std::string_view{ m_data, magic.size() } != magic)
+        return {};
+
+      m_at = magic.size();
+
+      return string(m_at, m_size);
+    }
+
+    // decode the record at m_at; at the end or on anything malformed there
+    // are no records left
+
+    auto next() noexcept -> bool {
+      auto at = m_at;
+
+      auto size = varint(at, m_size);
+
+      if (!size || *size > m_size - at)
+        return false;
+
+      auto end = at + static_cast<std::size_t>(*size);
+
+      auto common = varint(at, end);
+
+      if (!common || *common > m_path.size())
+        return false;
+
+      auto rest = string(at, end);
+
+      if (!rest || end - at < 8)
+        return false;
+
+      m_path.resize(static_cast<std::size_t>(*common));
+      m_path.append(*rest);
+
+      std::memcpy(&m_mtime, m_data + at, 8);
+
+      at += 8;
+
+      auto count = varint(at, end);
+
+      if (!count)
+        return false;
+
+      m_count = *count;
+      m_entries = at;
+      m_end = end;
+      m_at = end;
+      m_loaded = true;
+
+      return true;
+    }
+
+    const char* m_data;
+
+    std::size_t m_size;
+
+    std::size_t m_at = 0;
+
+    std::string_view m_root;
+
+    // the record decoded last
+
+    std::string m_path;
+
+    std::int64_t m_mtime = 0;
+
+    std::uint64_t m_count = 0;
+
+    std::size_t m_entries = 0;
+
+    std::size_t m_end = 0;
+
+    bool m_loaded = false;
+  };
+
+  // a new database, written next to file and renamed over it once complete
+
+  struct writer {
+
+  public:
+
+    static auto create(const fs::path& file, std::string_view root) noexcept -> std::optional<writer> {
+      auto tmp = file.native() + ".tmp";
+
+      auto fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+      if (fd < 0)
+        return {};
+
+      auto obj = std::optional<writer>{ std::in_place, fd, file.native(), std::move(tmp) };
+
+      obj->m_buf.append(magic);
+      obj->put(root);
+
+      return obj;
+    }
+
+    writer(int fd, std::string file, std::string tmp) noexcept
+      : m_fd{ fd }
+      , m_file{ std::move(file) }
+      , m_tmp{ std::move(tmp) }
+    {
+    }
+
+    writer(writer&& o) noexcept
+      : m_fd{ std::exchange(o.m_fd, -1) }
+      , m_file{ std::move(o.m_file) }
+      , m_tmp{ std::move(o.m_tmp) }
+      , m_buf{ std::move(o.m_buf) }
+    {
+    }
+
+    writer(const writer&) = delete;
+
+    writer& operator=(const writer&) = delete;
+
+    writer& operator=(writer&&) = delete;
+
+    // a database left unfinished is removed
+
+    ~writer() {
+      if (m_fd < 0)
+        return;
+
+      ::close(m_fd);
+      ::unlink(m_tmp.c_str());
+    }
+
+    // directories come in depth-first order, their entries by name
+
+    void add(std::string_view dir, std::int64_t mtime, std::span<const entry> entries) {
+      auto common = std::size_t{ 0 };
+
+      while (common < std::min(dir.size(), m_last.size()) && dir[common] == m_last[common])
+        ++common;
+
+      m_record.clear();
+
+      varint(m_record, common);
+      varint(m_record, dir.size() - common);
+
+      m_record.append(dir.substr(common));
+      m_record.append(reinterpret_cast<const char*>(&mtime), 8);
+
+      varint(m_record, entries.size());
+
+      for (auto& e : entries) {
+        m_record.push_back(static_cast<char>(e.type));
+
+        varint(m_record, e.name.size());
+
+        m_record.append(e.name);
+      }
+
+      varint(m_buf, m_record.size());
+
+      m_buf.append(m_record);
+
+      m_last.assign(dir);
+
+      if (m_buf.size() >= flush_size)
+        flush();
+    }
+
+    // write what is left and put the database in place, false if it could
+    // not be
+
+    auto commit() noexcept -> bool {
+      auto ok = flush() && ::close(std::exchange(m_fd, -1)) == 0;
+
+      if (ok && ::rename(m_tmp.c_str(), m_file.c_str()) == 0)
+        return true;
+
+      ::unlink(m_tmp.c_str());
+
+      return false;
+    }
+
+  private:
+
+    static constexpr std::size_t flush_size = 1024 * 1024;
+
+    static void varint(std::string& out, std::uint64_t v) {
+      for (; v >= 0x80; v >>= 7)
+        out.push_back(static_cast<char>(v | 0x80));
+
+      out.push_back(static_cast<char>(v));
+    }
+
+    void put(std::string_view s) {
+      varint(m_buf, s.size());
+
+      m_buf.append(s);
+    }
+
+    auto flush() noexcept -> bool {
+      for (std::size_t at = 0; at < m_buf.size();) {
+        auto n = ::write(m_fd, m_buf.data() + at, m_buf.size() - at);
+
+        if (n < 0 && errno == EINTR)
+          continue;
+
+        if (n <= 0) {
+          m_failed = true;
+
+          return false;
+        }
+
+        at += static_cast<std::size_t>(n);
+      }
+
+      m_buf.clear();
+
+      return !m_failed;
+    }
+
+    int m_fd;
+
+    std::string m_file;
+
+    std::string m_tmp;
+
+    std::string m_buf;
+
+    std::string m_record;
+
+    std::string m_last;
+
+    bool m_failed = false;
+  };
+
+private:
+
+  static constexpr std::string_view magic = "FINDIDX1";
+};
+
+#endif
+
+// runs the commands of -exec ... {} +, at most slots of them at once: a
+// worker with a full batch starts its command and carries on walking, and
+// only waits when every slot is taken. A command failing, or exiting with
+// anything but 0, makes find fail at the end as well.
+
+struct launcher {
+
+public:
+
+  explicit launcher(std::size_t slots) noexcept : m_slots{ std::max<std::size_t>(slots, 1) } {}
+
+  launcher(const launcher&) = delete;
+
+  launcher& operator=(const launcher&) = delete;
+
+  // the bytes of arguments, pointers included, a command may be given:
+  // ARG_MAX less what the environment takes and some headroom, as find
+  // leaves
+
+  static auto arg_limit() noexcept -> std::size_t {
+#if defined(_WIN32)
+    return 32 * 1024;
+#else
+    auto max = ::sysconf(_SC_ARG_MAX);
+
+    auto limit = max > 0 ? static_cast<std::size_t>(max) : std::size_t{ 128 * 1024 };
+
+    auto taken = std::size_t{ 2048 };
+
+    for (auto** e = environ; *e; ++e)
+      taken += std::strlen(*e) + 1 + sizeof(char*);
+
+    return limit > 2 * taken ? limit - taken : limit / 2;
+#endif
+  }
+
+  // start argv, NULL-terminated, once fewer than slots commands run
+
+  void spawn(char* const* argv) noexcept {
+    stats::add(stats::commands);
+
+#if defined(_WIN32)
+    (void)argv;
+
+    m_failed.store(true, std::memory_order_relaxed);
+#else
+    while (m_running.fetch_add(1, std::memory_order_acq_rel) >= m_slots) {
+      m_running.fetch_sub(1, std::memory_order_acq_rel);
+
+      reap();
+    }
+
+    auto pid = pid_t{};
+
+    if (::posix_spawnp(&pid, argv[0], nullptr, nullptr, argv, environ) != 0) {
+      m_failed.store(true, std::memory_order_relaxed);
+
+      m_running.fetch_sub(1, std::memory_order_acq_rel);
+
+      return;
+    }
+
+    std::lock_guard guard{ m_mtx };
+
+    m_pids.push_back(pid);
+#endif
+  }
+
+  // wait for every command started, false if any failed
+
+  auto wait() noexcept -> bool {
+#if !defined(_WIN32)
+    while (m_running.load(std::memory_order_acquire) > 0)
+      reap();
+#endif
+
+    return !m_failed.load(std::memory_order_relaxed);
+  }
+
+private:
+
+#if !defined(_WIN32)
+
+  // wait for one of the commands started here to end, never for another
+  // child of the process, which may have some of its own. The first found
+  // over already is taken, the oldest is waited for otherwise. None may be
+  // waiting, those running may not have been started yet: their worker
+  // just took their slot.
+
+  void reap() noexcept {
+    auto pid = pid_t{ -1 };
+
+    auto status = 0;
+
+    auto over = false;
+
+    {
+      std::lock_guard guard{ m_mtx };
+
+      for (auto it = m_pids.begin(); it != m_pids.end(); ++it) {
+        auto res = ::waitpid(*it, &status, WNOHANG);
+
+        if (res != 0) {
+          pid = *it;
+          over = res == pid;
+
+          m_pids.erase(it);
+
+          break;
+        }
+      }
+
+      if (pid < 0 && !m_pids.empty()) {
+        pid = m_pids.front();
+
+        m_pids.pop_front();
+      }
+    }
+
+    if (pid < 0)
+      return std::this_thread::yield();
+
+    while (!over) {
+      if (::waitpid(pid, &status, 0) == pid)
+        over = true;
+      else if (errno != EINTR)
+        break;
+    }
+
+    // one that could not be waited for is not known to have succeeded
+
+    if (!over || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      m_failed.store(true, std::memory_order_relaxed);
+
+    m_running.fetch_sub(1, std::memory_order_acq_rel);
+  }
+
+  std::mutex m_mtx;
+
+  // started and not waited for yet, the oldest first
+
+  std::deque<pid_t> m_pids;
+
+#endif
+
+  std::size_t m_slots;
+
+  std::atomic<std::size_t> m_running{ 0 };
+
+  std::atomic<bool> m_failed{ false };
+};
+
+#if defined(__linux__)
+
+// the (device, inode) pairs met so far, for -L to tell a directory it went
+// through already and --dedup a file it printed under another name. A key
+// is 8 bytes: the whole inode number, salted with a small number for the
+// device, through a mix that is a bijection, so that no two inodes of a
+// device ever share a key, however high their bits go (as overlayfs sets
+// them with xino). Keys are spread over shards of open-addressing tables
+// and inserted with a compare-exchange, a shard only taking its lock alone
+// to grow, so that the set goes from a few thousand entries to hundreds of
+// millions without contention nor much more than 8 bytes each. The key 0,
+// which marks a free slot, and the devices past max_devices go to a plain
+// set under a mutex.
+
+struct inode_set {
+
+public:
+
+  static constexpr std::size_t shard_bits = 8;
+
+  // slots of a shard at first, a power of two
+
+  static constexpr std::size_t initial_slots = 256;
+
+  inode_set() {
+    for (auto& s : m_shards) {
+      s.slots = std::make_unique<std::atomic<std::uint64_t>[]>(initial_slots);
+      s.size = initial_slots;
+    }
+  }
+
+  // false if dev and ino were in already
+
+  auto insert(std::uint64_t dev, std::uint64_t ino) -> bool {
+    auto index = index_of(dev);
+
+    // already mixed, the key is its own hash
+
+    auto key = mix(ino ^ (index * 0x9e3779b97f4a7c15ull));
+
+    if (index == 0 || key == 0) {
+      std::lock_guard guard{ m_overflow_mtx };
+
+      return m_overflow.insert({ dev, ino }).second;
+    }
+
+    auto& s = m_shards[key >> (64 - shard_bits)];
+
+    while (true) {
+      auto size = std::size_t{};
+
+      {
+        std::shared_lock lck{ s.mtx };
+
+        size = s.size;
+
+        // past three quarters full the probes get long, grow first. Those
+        // inserting meanwhile may fill it up yet: a probe goes around it
+        // once at most, then grows it too.
+
+        if (s.used.load(std::memory_order_relaxed) < size / 4 * 3) {
+          auto mask = size - 1;
+
+          for (auto i = key & mask, n = std::size_t{}; n < size; i = (i + 1) & mask, ++n) {
+            auto cur = s.slots[i].load(std::memory_order_acquire);
+
+            if (cur == 0 && s.slots[i].compare_exchange_strong(cur, key, std::memory_order_acq_rel)) {
+              s.used.fetch_add(1, std::memory_order_relaxed);
+
+              return true;
+            }
+
+            if (cur == key)
+              return false;
+          }
+        }
+      }
+
+      grow(s, size);
+    }
+  }
+
+private:
+
+  static constexpr std::size_t max_devices = 1024;
+
+  struct shard {
+    std::shared_mutex mtx;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> slots;
+    std::size_t size = 0;
+    std::atomic<std::size_t> used{ 0 };
+  };
+
+  // the number of dev from 1 on, 0 past max_devices: there are only ever
+  // a few, and they are seen first long before the set is busy
+
+  auto index_of(std::uint64_t dev) -> std::uint64_t {
+    auto find = [&]() -> std::uint64_t {
+      auto n = m_devices_used.load(std::memory_order_acquire);
+
+      for (std::size_t i = 0; i < n; ++i)
+        if (m_devices[i].load(std::memory_order_relaxed) == dev)
+          return i + 1;
+
+      return 0;
+    };
+
+    if (auto i = find())
+      return i;
+
+    std::lock_guard guard{ m_devices_mtx };
+
+    if (auto i = find())
+      return i;
+
+    auto n = m_devices_used.load(std::memory_order_relaxed);
+
+    if (n == max_devices)
+      return 0;
+
+    m_devices[n].store(dev, std::memory_order_relaxed);
+
+    m_devices_used.store(n + 1, std::memory_order_release);
+
+    return n + 1;
+  }
+
+  // every bit of the inode into every bit of the key, the shard being
+  // picked by the high ones and the slot by the low ones, one to one
+
+  static constexpr auto mix(std::uint64_t k) noexcept -> std::uint64_t {
+    k = (k ^ (k >> 30)) * 0xbf58476d1ce4e5b9ull;
+    k = (k ^ (k >> 27)) * 0x94d049bb133111ebull;
+
+    return k ^ (k >> 31);
+  }
+
+  // double the shard, unless grown already since it was seen at from
+
+  static void grow(shard& s, std::size_t from) {
+    std::unique_lock lck{ s.mtx };
+
+    if (s.size != from)
+      return;
+
+    auto size = s.size * 2;
+
+    auto slots = std::make_unique<std::atomic<std::uint64_t>[]>(size);
+
+    for (std::size_t i = 0; i < s.size; ++i) {
+      auto key = s.slots[i].load(std::memory_order_relaxed);
+
+      if (key == 0)
+        continue;
+
+      auto at = key & (size - 1);
+
+      while (slots[at].load(std::memory_order_relaxed) != 0)
+        at = (at + 1) & (size - 1);
+
+      slots[at].store(key, std::memory_order_relaxed);
+    }
+
+    s.slots = std::move(slots);
+    s.size = size;
+  }
+
+  std::array<shard, std::size_t{ 1 } << shard_bits> m_shards;
+
+  std::array<std::atomic<std::uint64_t>, max_devices> m_devices{};
+
+  std::atomic<std::size_t> m_devices_used{ 0 };
+
+  std::mutex m_devices_mtx;
+
+  std::set<std::pair<std::uint64_t, std::uint64_t>> m_overflow;
+
+  std::mutex m_overflow_mtx;
+};
+
+#endif
+
+struct finder {
+
+private:
+
+  struct type_filter {
+    enum kind : int {
+      directories,
+      files
+    } value;
+
+    type_filter(kind v) : value{ v } {}
+
+    static auto from(std::string_view t) noexcept
+      -> std::optional<type_filter>
+    {
+      if (t.size() != 1)
+        return {};
+
+      switch (t.at(0)) {
+
+      case 'd':
+        return directories;
+
+      case 'f':
+        return files;
+      }
+
+      return {};
+    }
+
+    auto repr() noexcept -> std::string_view {
+      switch (value) {
+
+      case directories:
+        return "directories";
+
+      case files:
+        return "files";
+      }
+    }
+  };
+
+  // the predicates of the command line, parsed into a tree and compiled to
+  // a flat list of tests, each with the test to jump to when it holds and
+  // when it does not: and/or short-circuit by where they jump and a
+  // negation only swaps the two. Between the actions, -print and -prune,
+  // the operands of an and/or are reordered by how much they need of the
+  // entry, so that whatever can be decided from the name alone is decided
+  // first. Without -print, an entry is printed when the whole holds.
+
+  struct expression {
+
+  public:
+
+    static auto parse(std::span<const std::string_view> args) -> std::expected<expression, error_code> {
+      auto obj = expression{};
+
+      if (args.empty())
+        return obj;
+
+      auto p = parser{ obj, args };
+
+      auto root = p.parse_or();
+
+      if (!root)
+        return std::unexpected{ root.error() };
+
+      if (p.m_at != args.size())
+        return make_unexpected(error_code::invalid_expr);
+
+      obj.tidy(*root);
+
+      obj.m_acts = std::ranges::any_of(obj.m_nodes, [](const node& n) { return n.value == node::test && is_action(n.code) && n.code != op::prune; });
+
+      obj.m_quits = std::ranges::any_of(obj.m_nodes, [](const node& n) { return n.value == node::test && n.code == op::quit; });
+
+      obj.m_effects = std::ranges::any_of(obj.m_nodes, [](const node& n) { return n.value == node::test && (n.code == op::remove || n.code == op::exec); });
+
+      obj.m_entry = obj.compile(*root, accept, reject);
+
+      obj.m_nodes.clear();
+      obj.m_nodes.shrink_to_fit();
+
+      return obj;
+    }
+
+    // predicates and the number of values each takes
+
+    static auto arity(std::string_view arg) noexcept -> std::optional<std::size_t> {
+      if (arg == "-type" || arg == "-name" || arg == "-iname" || arg == "-path" || arg == "-ipath")
+        return 1;
+
+      if (arg == "-size" || arg == "-mtime" || arg == "-newer" || arg == "-perm")
+        return 1;
+
+      if (arg == "-exec")
+        return variadic;
+
+      if (arg == "-print" || arg == "-prune" || arg == "-delete" || arg == "-quit" || is_operator(arg))
+        return 0;
+
+      return {};
+    }
+
+    // -exec takes every value up to the "{} +" that ends it
+
+    static constexpr std::size_t variadic = SIZE_MAX;
+
+    static auto ends_exec(std::span<const std::string_view> args) noexcept -> bool {
+      return args.size() >= 2 && args.back() == "+" && args[args.size() - 2] == "{}";
+    }
+
+    // the most -exec an expression may have, one bit of a verdict each
+
+    static constexpr std::size_t max_commands = 64;
+
+    // the command of each -exec, without its "{} +"
+
+    using command = std::vector<std::string>;
+
+    auto commands() const noexcept -> std::span<const command> { return m_commands; }
+
+    // whether -quit may end the walk, and whether anything is done to an
+    // entry besides printing it, by -delete or -exec
+
+    auto quits() const noexcept -> bool { return m_quits; }
+
+    auto effects() const noexcept -> bool { return m_effects; }
+
+    // what the actions decided for an entry: how many times to print it and
+    // whether not to descend into it
+
+    struct verdict {
+      std::uint32_t prints = 0;
+      std::uint64_t execs = 0;
+      bool prune = false;
+      bool remove = false;
+      bool quit = false;
+    };
+
+    // the most any test needs to know of an entry, and which fields of it
+
+    auto needs() const noexcept -> meta_hint {
+      auto res = meta_hint{};
+
+      for (auto& t : m_code) {
+        res.need = std::max(res.need, need_of(t.code));
+        res.fields |= fields_of(t.code);
+      }
+
+      return res;
+    }
+
+    // whether evaluating entry comes to a test that stats it, every test
+    // before deciding the way it will then, so that the listing can state
+    // those entries together; also when it is printed if printed is true,
+    // for what prints it to need the metadata
+
+    auto will_stat(const dir_entry& entry, bool printed = false) const noexcept -> bool {
+      auto res = verdict{};
+
+      auto at = m_entry;
+
+      while (at < reject) {
+        auto& t = m_code[at];
+
+        auto need = need_of(t.code);
+
+        if (need == meta_need::stat || (need == meta_need::type && !entry.known(meta_need::type)))
+          return true;
+
+        at = test(t, entry, res) ? t.on_true : t.on_false;
+      }
+
+      return printed && (m_acts ? res.prints > 0 : at == accept);
+    }
+
+    auto eval(const dir_entry& entry) const noexcept -> verdict {
+      auto res = verdict{};
+
+      auto at = m_entry;
+
+      while (at < reject && !res.quit) {
+        auto& t = m_code[at];
+
+        at = test(t, entry, res) ? t.on_true : t.on_false;
+      }
+
+      if (!m_acts)
+        res.prints = at == accept;
+
+      return res;
+    }
+
+    // the path as printed, joined in a buffer of the calling thread
+
+    static auto path_of(const dir_entry& entry) noexcept -> std::string_view {
+      thread_local auto buf = std::string{};
+
+      buf.assign(entry.dir);
+
+      if (!buf.empty() && buf.back() != '/')
+        buf += '/';
+
+      buf += entry.name;
+
+      return buf;
+    }
+
+  private:
+
+    enum class op : std::uint8_t {
+      type_dir,
+      type_file,
+      name,
+      name_set,
+      path,
+      size,
+      mtime,
+      newer,
+      perm_exact,
+      perm_all,
+      perm_any,
+      print,
+      prune,
+      exec,
+      remove,
+      quit,
+    };
+
+    // a number as -size and -mtime take it: +n for more than n, -n for
+    // less and n for exactly n, of units of the given size
+
+    struct bound {
+      enum kind : std::uint8_t {
+        less,
+        equal,
+        greater,
+      } value;
+
+      std::int64_t n;
+
+      std::int64_t unit = 1;
+
+      auto match(std::int64_t v) const noexcept -> bool {
+        return value == less ? v < n : value == greater ? v > n : v == n;
+      }
+
+      static auto from(std::string_view s) noexcept -> std::optional<bound> {
+        auto res = bound{ equal, 0 };
+
+        if (s.starts_with('+') || s.starts_with('-')) {
+          res.value = s[0] == '+' ? greater : less;
+
+          s.remove_prefix(1);
+        }
+
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), res.n);
+
+        if (ec != std::errc{} || ptr != s.data() + s.size() || s.empty() || res.n < 0)
+          return {};
+
+        return res;
+      }
+    };
+
+    using label = std::uint32_t;
+
+    static constexpr label accept = UINT32_MAX;
+
+    static constexpr label reject = UINT32_MAX - 1;
+
+    struct instr {
+      op code;
+      std::uint32_t arg;
+      label on_true;
+      label on_false;
+    };
+
+    struct node {
+      enum kind : std::uint8_t {
+        test,
+        not_,
+        and_,
+        or_,
+      } value;
+
+      op code = {};
+
+      std::uint32_t arg = 0;
+
+      std::vector<std::size_t> children = {};
+    };
+
+    static constexpr auto need_of(op o) noexcept -> meta_need {
+      switch (o) {
+
+      case op::type_dir: return meta_need::type;
+      case op::type_file: return meta_need::type;
+      case op::size: return meta_need::stat;
+      case op::mtime: return meta_need::stat;
+      case op::newer: return meta_need::stat;
+      case op::perm_exact: return meta_need::stat;
+      case op::perm_all: return meta_need::stat;
+      case op::perm_any: return meta_need::stat;
+      default: return meta_need::name;
+
+      }
+    }
+
+    static constexpr auto fields_of(op o) noexcept -> std::uint32_t {
+      switch (o) {
+
+      case op::type_dir: return meta_field::type;
+      case op::type_file: return meta_field::type;
+      case op::size: return meta_field::size;
+      case op::mtime: return meta_field::mtime;
+      case op::newer: return meta_field::mtime;
+      case op::perm_exact: return meta_field::perms;
+      case op::perm_all: return meta_field::perms;
+      case op::perm_any: return meta_field::perms;
+      default: return 0;
+
+      }
+    }
+
+    // what a test costs, ordered by need first and then by the work done
+    // on the name: a path is joined before being matched
+
+    static constexpr auto cost_of(op o) noexcept -> int {
+      switch (o) {
+
+      case op::name: return 0;
+      case op::name_set: return 0;
+      case op::path: return 1;
+      case op::type_dir: return 2;
+      case op::type_file: return 2;
+      case op::size: return 3;
+      case op::mtime: return 3;
+      case op::newer: return 3;
+      case op::perm_exact: return 3;
+      case op::perm_all: return 3;
+      case op::perm_any: return 3;
+      case op::print: return 0;
+      case op::prune: return 0;
+      case op::exec: return 0;
+      case op::remove: return 0;
+      case op::quit: return 0;
+
+      }
+      return 0;
+    }
+
+    static constexpr auto is_action(op o) noexcept -> bool {
+      return o == op::print || o == op::prune || o == op::exec || o == op::remove || o == op::quit;
+    }
+
+    static auto is_operator(std::string_view arg) noexcept -> bool {
+      return arg == "(" || arg == ")" || arg == "!" || arg == "-not"
+        || arg == "-a" || arg == "-and" || arg == "-o" || arg == "-or";
+    }
+
+    // recursive descent over
+    //
+    //   or    := and { (-o | -or) and }
+    //   and   := unary { [-a | -and] unary }
+    //   unary := (! | -not) unary | ( or ) | test
+
+    struct parser {
+      expression& m_expr;
+
+      std::span<const std::string_view> m_args;
+
+      std::size_t m_at = 0;
+
+      using result = std::expected<std::size_t, error_code>;
+
+      auto peek() const noexcept -> std::string_view { return m_at < m_args.size() ? m_args[m_at] : std::string_view{}; }
+
+      auto done() const noexcept -> bool { return m_at == m_args.size(); }
+
+      auto parse_or() -> result {
+        return parse_chain(node::or_, [this] { return parse_and(); }, [this] {
+          if (peek() != "-o" && peek() != "-or")
+            return false;
+
+          ++m_at;
+
+          return true;
+        });
+      }
+
+      auto parse_and() -> result {
+        return parse_chain(node::and_, [this] { return parse_unary(); }, [this] {
+          if (peek() == "-a" || peek() == "-and") {
+            ++m_at;
+
+            return true;
+          }
+
+          return !done() && peek() != ")" && peek() != "-o" && peek() != "-or";
+        });
+      }
+
+      auto parse_chain(node::kind kind, auto&& operand, auto&& more) -> result {
+        auto first = operand();
+
+        if (!first || !more())
+          return first;
+
+        auto n = node{ kind };
+
+        n.children.push_back(*first);
+
+        do {
+          auto next = operand();
+
+          if (!next)
+            return next;
+
+          n.children.push_back(*next);
+        } while (more());
+
+        return add(std::move(n));
+      }
+
+      auto parse_unary() -> result {
+        if (done())
+          return make_unexpected(error_code::invalid_expr);
+
+        auto arg = m_args[m_at++];
+
+        if (arg == "!" || arg == "-not") {
+          auto child = parse_unary();
+
+          if (!child)
+            return child;
+
+          auto n = node{ node::not_ };
+
+          n.children.push_back(*child);
+
+          return add(std::move(n));
+        }
+
+        if (arg == "(") {
+          auto inner = parse_or();
+
+          if (!inner)
+            return inner;
+
+          if (peek() != ")")
+            return make_unexpected(error_code::invalid_expr);
+
+          ++m_at;
+
+          return inner;
+        }
+
+        if (arg == ")" || arg == "-a" || arg == "-and" || arg == "-o" || arg == "-or")
+          return make_unexpected(error_code::invalid_expr);
+
+        if (!arity(arg))
+          return make_unexpected(error_code::unknown_arg);
+
+        auto n = node{ node::test };
+
+        if (arg == "-print" || arg == "-prune" || arg == "-delete" || arg == "-quit") {
+          n.code = arg == "-print" ? op::print : arg == "-prune" ? op::prune : arg == "-delete" ? op::remove : op::quit;
+
+          return add(std::move(n));
+        }
+
+        if (arg == "-exec") {
+          auto from = m_at;
+
+          while (!ends_exec(m_args.subspan(from, m_at - from)) && !done())
+            ++m_at;
+
+          auto values = m_args.subspan(from, m_at - from);
+
+          auto& commands = m_expr.m_commands;
+
+          if (!ends_exec(values) || values.size() < 3 || commands.size() == max_commands)
+            return make_unexpected(error_code::invalid_arg);
+
+          n.code = op::exec;
+          n.arg = static_cast<std::uint32_t>(commands.size());
+
+          commands.emplace_back(values.begin(), values.end() - 2);
+
+          return add(std::move(n));
+        }
+
+        if (done())
+          return make_unexpected(error_code::invalid_arg);
+
+        auto value = m_args[m_at++];
+
+        if (arg == "-type") {
+          auto type = type_filter::from(value);
+
+          if (!type)
+            return make_unexpected(error_code::invalid_arg);
+
+          n.code = type->value == type_filter::directories ? op::type_dir : op::type_file;
+        }
+        else if (arg == "-size" || arg == "-mtime" || arg == "-newer") {
+          auto b = m_expr.bound_of(arg, value);
+
+          if (!b)
+            return make_unexpected(error_code::invalid_arg);
+
+          n.code = arg == "-size" ? op::size : arg == "-mtime" ? op::mtime : op::newer;
+          n.arg = static_cast<std::uint32_t>(m_expr.m_bounds.size());
+
+          m_expr.m_bounds.push_back(*b);
+        }
+        else if (arg == "-perm") {
+          n.code = value.starts_with('-') ? op::perm_all : value.starts_with('/') ? op::perm_any : op::perm_exact;
+
+          if (n.code != op::perm_exact)
+            value.remove_prefix(1);
+
+          auto mode = std::uint32_t{};
+
+          auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), mode, 8);
+
+          if (ec != std::errc{} || ptr != value.data() + value.size() || value.empty() || mode > 07777)
+            return make_unexpected(error_code::invalid_arg);
+
+          n.arg = mode;
+        }
+        else {
+          n.code = arg == "-name" || arg == "-iname" ? op::name : op::path;
+          n.arg = static_cast<std::uint32_t>(m_expr.m_globs.size());
+
+          m_expr.m_globs.push_back(glob::compile(value, arg == "-iname" || arg == "-ipath"));
+        }
+
+        return add(std::move(n));
+      }
+
+      auto add(node n) -> std::size_t {
+        m_expr.m_nodes.push_back(std::move(n));
+
+        return m_expr.m_nodes.size() - 1;
+      }
+    };
+
+    // the bound of -size (in 512-byte blocks unless followed by one of
+    // c, w, b, k, M or G), -mtime (in days) or -newer (the modification
+    // time of the file named, in ns)
+
+    auto bound_of(std::string_view arg, std::string_view value) const -> std::optional<bound> {
+      if (arg == "-newer") {
+        auto t = mtime_of(std::string{ value });
+
+        if (!t)
+          return {};
+
+        return bound{ bound::greater, *t };
+      }
+
+      auto unit = std::int64_t{ arg == "-size" ? 512 : 86'400'000'000'000LL };
+
+      if (arg == "-size" && !value.empty()) {
+        constexpr std::string_view suffixes = "cwbkMG";
+
+        constexpr std::int64_t units[] = { 1, 2, 512, 1LL << 10, 1LL << 20, 1LL << 30 };
+
+        if (auto at = suffixes.find(value.back()); at != std::string_view::npos) {
+          unit = units[at];
+
+          value.remove_suffix(1);
+        }
+      }
+
+      auto b = bound::from(value);
+
+      if (b)
+        b->unit = unit;
+
+      return b;
+    }
+
+    // the modification time of path in ns since the epoch, of the symlink
+    // itself where it is one as find does for -newer without -L
+
+    static auto mtime_of(const std::string& path) noexcept -> std::optional<std::int64_t> {
+#if defined(__linux__)
+      struct statx stx;
+
+      if (::statx(AT_FDCWD, path.c_str(), AT_SYMLINK_NOFOLLOW, STATX_MTIME, &stx) != 0)
+        return {};
+
+      return stx.stx_mtime.tv_sec * 1'000'000'000LL + stx.stx_mtime.tv_nsec;
+#else
+      auto ec = std::error_code{};
+
+      auto mtime = fs::last_write_time(path, ec);
+
+      if (ec)
+        return {};
+
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::clock_cast<std::chrono::system_clock>(mtime).time_since_epoch()).count();
+#endif
+    }
+
+    // merge the operands of nested ands (ors) into their parent, then in
+    // every run of operands without actions merge the -name and -iname
+    // operands of an or into a set where they can be, and put the cheapest
+    // operands first
+
+    void tidy(std::size_t at) {
+      if (m_nodes[at].value == node::test)
+        return;
+
+      if (m_nodes[at].value == node::not_)
+        return tidy(m_nodes[at].children[0]);
+
+      auto children = std::vector<std::size_t>{};
+
+      for (auto c : std::exchange(m_nodes[at].children, {})) {
+        tidy(c);
+
+        if (m_nodes[c].value == m_nodes[at].value)
+          children.insert(children.end(), m_nodes[c].children.begin(), m_nodes[c].children.end());
+        else
+          children.push_back(c);
+      }
+
+      auto res = std::vector<std::size_t>{};
+
+      auto run = std::vector<std::size_t>{};
+
+      auto flush = [&] {
+        if (m_nodes[at].value == node::or_) {
+          merge_names(run, false);
+          merge_names(run, true);
+        }
+
+        std::ranges::stable_sort(run, {}, [this](std::size_t c) { return cost(c); });
+
+        res.insert(res.end(), run.begin(), run.end());
+
+        run.clear();
+      };
+
+      for (auto c : children) {
+        if (pure(c)) {
+          run.push_back(c);
+
+          continue;
+        }
+
+        flush();
+
+        res.push_back(c);
+      }
+
+      flush();
+
+      m_nodes[at].children = std::move(res);
+    }
+
+    auto pure(std::size_t at) const -> bool {
+      auto& n = m_nodes[at];
+
+      if (n.value == node::test)
+        return !is_action(n.code);
+
+      return std::ranges::all_of(n.children, [this](std::size_t c) { return pure(c); });
+    }
+
+    // below that many patterns trying them in turn is as cheap as hashing
+
+    static constexpr std::size_t min_set = 3;
+
+    // replace the name tests in children that a glob_set takes by one test
+    // of a set of them all, in place of the first
+
+    void merge_names(std::vector<std::size_t>& children, bool icase) {
+      auto takes = [&](std::size_t c) {
+        auto& n = m_nodes[c];
+
+        return n.value == node::test && n.code == op::name
+          && m_globs[n.arg].icase() == icase && glob_set::accepts(m_globs[n.arg]);
+      };
+
+      if (static_cast<std::size_t>(std::ranges::count_if(children, takes)) < min_set)
+        return;
+
+      auto set = glob_set{ icase };
+
+      auto first = *std::ranges::find_if(children, takes);
+
+      for (auto c : children)
+        if (takes(c))
+          set.add(m_globs[m_nodes[c].arg]);
+
+      std::erase_if(children, [&](std::size_t c) { return c != first && takes(c); });
+
+      m_nodes[first].code = op::name_set;
+      m_nodes[first].arg = static_cast<std::uint32_t>(m_sets.size());
+
+      m_sets.push_back(std::move(set));
+    }
+
+    auto cost(std::size_t at) const -> int {
+      auto& n = m_nodes[at];
+
+      if (n.value == node::test)
+        return cost_of(n.code);
+
+      auto res = 0;
+
+      for (auto c : n.children)
+        res = std::max(res, cost(c));
+
+      return res;
+    }
+
+    // emit the tests of a subtree, the last operand first so that every
+    // jump target exists already, and return the label to enter it at
+
+    auto compile(std::size_t at, label on_true, label on_false) -> label {
+      auto& n = m_nodes[at];
+
+      switch (n.value) {
+
+      case node::test:
+        m_code.push_back({ n.code, n.arg, on_true, on_false });
+
+        return static_cast<label>(m_code.size() - 1);
+
+      case node::not_:
+        return compile(n.children[0], on_false, on_true);
+
+      case node::and_:
+      case node::or_: {
+        auto next = n.value == node::and_ ? on_true : on_false;
+
+        for (auto it = n.children.rbegin(); it != n.children.rend(); ++it)
+          next = n.value == node::and_
+            ? compile(*it, next, on_false)
+            : compile(*it, on_true, next);
+
+        return next;
+      }
+      }
+
+      return reject;
+    }
+
+    auto test(const instr& t, const dir_entry& entry, verdict& res) const noexcept -> bool {
+      switch (t.code) {
+
+      case op::print:
+        ++res.prints;
+
+        return true;
+
+      case op::prune:
+        res.prune = true;
+
+        return true;
+
+      case op::exec:
+        res.execs |= std::uint64_t{ 1 } << t.arg;
+
+        return true;
+
+      // -delete is done by the walk, a directory once what is below it is
+      // gone, and so always true here
+
+      case op::remove:
+        res.remove = true;
+
+        return true;
+
+      // nothing is tested past -quit
+
+      case op::quit:
+        res.quit = true;
+
+        return false;
+
+      case op::type_dir:
+        return entry.type() == fs::file_type::directory;
+
+      case op::type_file:
+        return entry.type() == fs::file_type::regular;
+
+      case op::name:
+        return m_globs[t.arg].match(entry.name);
+
+      case op::name_set:
+        return m_sets[t.arg].match(entry.name);
+
+      case op::path:
+        return m_globs[t.arg].match(path_of(entry));
+
+      case op::size: {
+        auto& b = m_bounds[t.arg];
+
+        // in units rounded up, as find does
+
+        auto size = static_cast<std::int64_t>(entry.meta().size);
+
+        return b.match((size + b.unit - 1) / b.unit);
+      }
+
+      case op::mtime: {
+        auto& b = m_bounds[t.arg];
+
+        auto age = m_now - entry.meta().mtime;
+
+        return b.match(age >= 0 ? age / b.unit : (age + 1) / b.unit - 1);
+      }
+
+      case op::newer:
+        return m_bounds[t.arg].match(entry.meta().mtime);
+
+      case op::perm_exact:
+        return perms_of(entry) == t.arg;
+
+      case op::perm_all:
+        return (perms_of(entry) & t.arg) == t.arg;
+
+      case op::perm_any:
+        return t.arg == 0 || (perms_of(entry) & t.arg) != 0;
+      }
+
+      return false;
+    }
+
+    static auto perms_of(const dir_entry& entry) noexcept -> std::uint32_t {
+      return static_cast<std::uint32_t>(entry.meta().perms) & 07777;
+    }
+
+    std::vector<glob> m_globs;
+
+    std::vector<glob_set> m_sets;
+
+    std::vector<bound> m_bounds;
+
+    std::vector<instr> m_code;
+
+    std::vector<node> m_nodes;
+
+    std::vector<command> m_commands;
+
+    label m_entry = accept;
+
+    // whether an action other than -prune is there, so that nothing is
+    // printed unless asked for
+
+    bool m_acts = false;
+
+    bool m_quits = false;
+
+    bool m_effects = false;
+
+    // what -mtime counts the age of entries from, the time find started at
+
+    std::int64_t m_now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  };
+
+  enum class stats_format {
+    text,
+    json,
+  };
+
+  // --progress reports every second, --progress=signal on SIGUSR1 only; the
+  // former does on SIGUSR1 as well
+
+  enum class progress_mode {
+    periodic,
+    signal,
+  };
+
+  // what is printed instead of the paths that match: how many they are,
+  // their bytes by extension or their bytes by entry of the root
+
+  enum class aggregate {
+    count,
+    by_ext,
+    du,
+  };
+
+  struct params {
+    std::vector<fs::path> paths;
+    expression expr;
+    std::optional<std::size_t> jobs;
+    std::optional<std::size_t> maxdepth;
+    std::optional<std::size_t> mindepth;
+    std::optional<std::size_t> limit;
+    std::optional<stats_format> stats;
+    std::optional<aggregate> totals;
+    bool print0 = false;
+    bool sorted = false;
+    std::optional<fs::path> index;
+    std::optional<fs::path> index_build;
+    bool io_uring = false;
+    bool dont_sync = false;
+    bool xdev = false;
+    std::optional<std::size_t> device_jobs;
+    std::optional<std::size_t> max_pending;
+    bool follow = false;
+    bool dedup = false;
+    bool adaptive = false;
+    std::optional<progress_mode> progress;
+
+    params() = default;
+
+    params(const params&) = delete;
+
+    params(params&&) = default;
+
+    params& operator=(const params&) = delete;
+
+    params& operator=(params&&) = default;
+
+    // the most any predicate needs to know of an entry
+
+    auto needs() const noexcept -> meta_hint {
+      auto hint = expr.needs();
+
+      hint.dont_sync = dont_sync;
+
+      if (sizes()) {
+        hint.need = meta_need::stat;
+        hint.fields |= meta_field::type | meta_field::size;
+      }
+
+      // a directory, or a file with other links, is told apart by its inode
+
+      hint.follow = follow;
+
+      if (follow || dedup)
+        hint.fields |= meta_field::type | meta_field::dev | meta_field::ino;
+
+      if (dedup)
+        hint.fields |= meta_field::nlink;
+
+      return hint;
+    }
+
+    // whether the size of what matches is added up
+
+    auto sizes() const noexcept -> bool { return totals && *totals != aggregate::count; }
+
+    static auto count_from(const std::string_view& s, std::size_t least = 1) noexcept
+      -> std::optional<std::size_t>
+    {
+      auto n = std::size_t{};
+
+      auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), n);
+
+      if (ec != std::errc{} || ptr != s.data() + s.size() || n < least)
+        return {};
+
+      return n;
+    }
+
+    // the options may come anywhere, everything else is the expression
+
+    static auto from(const opts& opts) noexcept
+      -> std::expected<params, error_code>
+    {
+      auto obj = params{};
+
+      //obj.paths.push_back(fs::current_path()); // uncomment to achieve same find behaviour
+
+      if (opts.size() <= 1)
+        return obj;
+
+      // the roots are whatever comes before the first option or test, but
+      // for -L and -P that find takes before them, the last one winning
+
+      auto it = opts.it(1);
+
+#if defined(__linux__)
+      for (; it != opts.end() && (*it == "-L" || *it == "-P"); ++it)
+        obj.follow = *it == "-L";
+#endif
+
+      for (; it != opts.end() && !(*it).starts_with("-") && *it != "(" && *it != "!"; ++it)
+        obj.paths.emplace_back(*it);
+
+      auto expr = std::vector<std::string_view>{};
+
+      for (; it != opts.end(); ++it) {
+        if (*it == "-print0") {
+          if (obj.print0)
+            return make_unexpected(error_code::duplicate_arg);
+
+          obj.print0 = true;
+        }
+
+        else if (*it == "-sorted" || *it == "--deterministic") {
+          if (obj.sorted)
+            return make_unexpected(error_code::duplicate_arg);
+
+          obj.sorted = true;
+        }
+
+#if defined(__linux__)
+        else if (*it == "--index" || *it == "--index-build") {
+          auto& value = *it == "--index" ? obj.index : obj.index_build;
+
+          if (value)
+            return make_unexpected(error_code::duplicate_arg);
+
+          if (++it == opts.end())
+            return make_unexpected(error_code::invalid_arg);
+
+          value = *it;
+        }
+
+        else if (*it == "--io-uring" || *it == "--dont-sync") {
+#if !defined(FIND_IO_URING)
+          // built without the backend
+
+          if (*it == "--io-uring")
+            return make_unexpected(error_code::unknown_arg);
+#endif
+
+          auto& value = *it == "--io-uring" ? obj.io_uring : obj.dont_sync;
+
+          if (value)
+            return make_unexpected(error_code::duplicate_arg);
+
+          value = true;
+        }
+
+        else if (*it == "-L" || *it == "--dedup") {
+          auto& value = *it == "-L" ? obj.follow : obj.dedup;
+
+          if (value)
+            return make_unexpected(error_code::duplicate_arg);
+
+          value = true;
+        }
+
+        else if (*it == "-xdev" || *it == "-mount") {
+          if (obj.xdev)
+            return make_unexpected(error_code::duplicate_arg);
+
+          obj.xdev = true;
+        }
+
+        else if (*it == "--device-jobs") {
+          if (obj.device_jobs)
+            return make_unexpected(error_code::duplicate_arg);
+
+          if (++it == opts.end())
+            return make_unexpected(error_code::invalid_arg);
+
+          obj.device_jobs = count_from(*it);
+
+          if (!obj.device_jobs)
+            return make_unexpected(error_code::invalid_arg);
+        }
+#endif
+
+        else if (*it == "-count" || *it == "--summary-by-ext" || *it == "--du") {
+          if (obj.totals)
+            return make_unexpected(error_code::duplicate_arg);
+
+          obj.totals = *it == "-count" ? aggregate::count : *it == "--du" ? aggregate::du : aggregate::by_ext;
+        }
+
+        else if (*it == "--max-pending") {
+          if (obj.max_pending)
+            return make_unexpected(error_code::duplicate_arg);
+
+          if (++it == opts.end())
+            return make_unexpected(error_code::invalid_arg);
+
+          obj.max_pending = count_from(*it);
+
+          if (!obj.max_pending)
+            return make_unexpected(error_code::invalid_arg);
+        }
+
+        else if (*it == "--progress" || *it == "--progress=signal") {
+          if (obj.progress)
+            return make_unexpected(error_code::duplicate_arg);
+
+          obj.progress = *it == "--progress" ? progress_mode::periodic : progress_mode::signal;
+        }
+
+        else if (*it == "--stats" || *it == "--stats=json") {
+          if (obj.stats)
+            return make_unexpected(error_code::duplicate_arg);
+
+          obj.stats = *it == "--stats" ? stats_format::text : stats_format::json;
+        }
+
+        else if (*it == "-j" || *it == "-maxdepth" || *it == "-mindepth" || *it == "-limit") {
+          auto& value = *it == "-j" ? obj.jobs : *it == "-maxdepth" ? obj.maxdepth : *it == "-mindepth" ? obj.mindepth : obj.limit;
+
+          // -j auto is a -j as well, either form given twice is a duplicate
+
+          if (value || (&value == &obj.jobs && obj.adaptive))
+            return make_unexpected(error_code::duplicate_arg);
+
+          auto least = *it == "-j" || *it == "-limit" ? 1 : 0;
+
+          if (++it == opts.end())
+            return make_unexpected(error_code::invalid_arg);
+
+          // -j auto starts with a worker per core and lets the monitor
+          // tune how many run
+
+          if (&value == &obj.jobs && *it == "auto") {
+            obj.adaptive = true;
+
+            continue;
+          }
+
+          value = count_from(*it, least);
+
+          if (!value)
+            return make_unexpected(error_code::invalid_arg);
+        }
+
+        else {
+          auto n = expression::arity(*it);
+
+          if (!n)
+            return make_unexpected(error_code::unknown_arg);
+
+          expr.push_back(*it);
+
+          // a value is never an option, -name -j included
+
+          for (auto i = *n; i > 0 && ++it != opts.end(); --i) {
+            expr.push_back(*it);
+
+            if (*n == expression::variadic && expression::ends_exec(expr))
+              break;
+          }
+
+          if (it == opts.end())
+            break;
+        }
+      }
+
+      auto parsed = expression::parse(expr);
+
+      if (!parsed)
+        return std::unexpected{ parsed.error() };
+
+      obj.expr = std::move(*parsed);
+
+      // -sorted orders the output only: the entries after the one quitting
+      // would still be deleted or run a command on before it got printed
+
+      if (obj.sorted && obj.expr.quits() && obj.expr.effects())
+        return make_unexpected(error_code::invalid_expr, "-quit cannot be used with -delete nor -exec under -sorted!");
+
+#if defined(__linux__)
+      // an index is of one tree, walked without the pool nor devices
+
+      if ((obj.index || obj.index_build) && (obj.paths.size() > 1 || obj.xdev || obj.follow || obj.dedup))
+        return make_unexpected(error_code::invalid_arg);
+#endif
+
+      return obj;
+    }
+  } m_params;
+
+  // with -sorted, what a directory contributes to the output: the lines of
+  // its entries ordered by name, through the end of each in text, and the
+  // listing of every entry that is descended into, to be written right
+  // after that entry. The worker visiting the directory fills it in, in a
+  // single block of its arena, and then marks it ready. Its job may be
+  // queued twice, again for emit() to have it first: the first to claim
+  // it visits the directory, each keeps the listing until done with it,
+  // as does the output until it is written.
+
+  struct listing {
+    struct item {
+      std::size_t end;
+      std::uint32_t prints;
+      listing* child;
+      bool quit = false;
+    };
+
+    std::span<const item> items;
+
+    std::string_view text;
+
+    void* block = nullptr;
+
+    // the directory, only for whoever claims it, and its lane
+
+    dir_node* node = nullptr;
+
+    std::size_t lane = 0;
+
+    std::atomic<bool> ready{ false };
+
+    std::atomic<bool> claimed{ false };
+
+    std::atomic<bool> expedited{ false };
+
+    std::atomic<std::uint32_t> refs;
+
+    static auto make(arena& arena, std::uint32_t refs = 2) -> listing* {
+      auto* l = ::new (arena.allocate(sizeof(listing))) listing{};
+
+      l->refs.store(refs, std::memory_order_relaxed);
+
+      return l;
+    }
+
+    inline auto size() const noexcept -> std::size_t { return items.size_bytes() + text.size(); }
+
+    static void unref(listing* l) noexcept {
+      if (l->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+      if (l->block)
+        arena::release(l->block);
+
+      l->~listing();
+
+      arena::release(l);
+    }
+  };
+
+  // where the output of the listings is at, from the root listing down
+  // to the one written next
+
+  struct frame {
+    listing* l;
+    std::size_t item;
+    std::size_t from;
+  };
+
+  // a directory to visit and, with -sorted, where its entries go. The
+  // lane is kept apart, the node may be gone by the time a job that lost
+  // the claim to its listing is handed out
+
+  struct job {
+    dir_node* node;
+    listing* out;
+    std::size_t at = node->lane();
+
+    inline auto lane() const noexcept -> std::size_t { return at; }
+  };
+
+  // an entry waiting to be sorted, its name in the scratch of the worker
+
+  struct pending {
+    std::size_t at;
+    std::size_t size;
+    std::uint32_t prints;
+    listing* child;
+    bool quit;
+  };
+
+  struct scratch {
+    std::string names;
+
+    std::vector<pending> entries;
+
+    std::string lines;
+
+    std::vector<listing::item> items;
+  };
+
+  using dir_pool = work_pool<job>;
+
+  // the paths a worker gathered for a command of -exec, NUL-terminated,
+  // and how many bytes of arguments they take
+
+  struct command_batch {
+    std::string paths;
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+  };
+
+  // the totals of a worker for -count, --summary-by-ext (of regular files)
+  // and --du, merged
+  // once the walk is over: no worker ever waits for another on them
+
+  struct string_hash {
+    using is_transparent = void;
+
+    auto operator()(std::string_view s) const noexcept -> std::size_t { return std::hash<std::string_view>{}(s); }
+  };
+
+  template<typename T>
+  using string_map = std::unordered_map<std::string, T, string_hash, std::equal_to<>>;
+
+  struct ext_total {
+    std::uint64_t count = 0;
+    std::uint64_t bytes = 0;
+  };
+
+  struct tally {
+    std::uint64_t count = 0;
+
+    string_map<ext_total> exts;
+
+    string_map<std::uint64_t> tops;
+
+    string_map<std::uint64_t> roots;
+  };
+
+  // where a directory is: its device and the lane of the pool for it
+
+  struct device {
+    std::uint64_t dev = 0;
+    std::uint16_t lane = 0;
+  };
+
+#if defined(__linux__)
+
+  using string_set = std::unordered_set<std::string, string_hash, std::equal_to<>>;
+
+  // the devices the walk comes across, each given a lane of the pool with
+  // a cap on how many of its directories are listed at once. Mount points
+  // are read from /proc/self/mountinfo up front: only a directory named
+  // like one of them may be on another device than its parent, so that is
+  // the only kind that is ever stated for it. Network filesystems and
+  // spinning disks gain little from more requests in flight than a few,
+  // the latter lose to seeking, so they get a cap of their own unless
+  // --device-jobs sets one for every device; the rest take all workers.
+
+  struct devices {
+
+  public:
+
+    static constexpr std::size_t network_cap = 4;
+
+    static constexpr std::size_t rotational_cap = 2;
+
+    explicit devices(std::optional<std::size_t> cap) : m_cap{ cap } {
+      auto text = slurp("/proc/self/mountinfo");
+
+      for (auto line : std::views::split(std::string_view{ text }, '\n'))
+        add_mount(std::string_view{ line.begin(), line.end() });
+    }
+
+    // whether a directory called name may be a mount point
+
+    inline auto may_mount(std::string_view name) const -> bool { return m_names.contains(name); }
+
+    // the lane of dev, and the cap to put on it when it is seen first; lane
+    // 0 is for devices past the lanes of the pool
+
+    auto lane(std::uint64_t dev) -> std::pair<std::uint16_t, std::optional<std::size_t>> {
+      std::lock_guard guard{ m_mtx };
+
+      auto it = std::ranges::find(m_devs, dev);
+
+      if (it != m_devs.end())
+        return { static_cast<std::uint16_t>(it - m_devs.begin() + 1), {} };
+
+      if (m_devs.size() + 1 >= dir_pool::max_lanes)
+        return { 0, {} };
+
+      m_devs.push_back(dev);
+
+      return { static_cast<std::uint16_t>(m_devs.size()), cap_of(dev) };
+    }
+
+  private:
+
+    static auto slurp(const char* file) -> std::string {
+      auto text = std::string{};
+
+      auto fd = ::open(file, O_RDONLY | O_CLOEXEC);
+
+      if (fd < 0)
+        return text;
+
+      char buf[4096];
+
+      for (ssize_t n; (n = ::read(fd, buf, sizeof(buf))) > 0;)
+        text.append(buf, static_cast<std::size_t>(n));
+
+      ::close(fd);
+
+      return text;
+    }
+
+    // a line of mountinfo: id, parent id, major:minor, root, mount point,
+    // options, optional fields up to a lone "-", then the filesystem type
+
+    void add_mount(std::string_view line) {
+      auto field = [&]() {
+        auto n = std::min(line.find(' '), line.size());
+
+        auto f = line.substr(0, n);
+
+        line.remove_prefix(std::min(n + 1, line.size()));
+
+        return f;
+      };
+
+      field();
+      field();
+
+      auto devno = field();
+
+      field();
+
+      auto point = field();
+
+      auto sep = line.find(" - ");
+
+      if (point.empty() || sep == std::string_view::npos)
+        return;
+
+      line.remove_prefix(sep + 3);
+
+      auto type = field();
+
+      auto major = 0u;
+      auto minor = 0u;
+
+      auto colon = devno.find(':');
+
+      if (colon == std::string_view::npos)
+        return;
+
+      std::from_chars(devno.data(), devno.data() + colon, major);
+      std::from_chars(devno.data() + colon + 1, devno.data() + devno.size(), minor);
+
+      m_types.emplace(makedev(major, minor), type);
+
+      // the name is all that is matched, as it is on disk
+
+      auto path = unescape(point);
+
+      m_names.emplace(path.substr(path.find_last_of('/') + 1));
+    }
+
+    // mountinfo writes a space, a tab, a newline and a backslash of a path
+    // as octal escapes, \040 for a space...
+
+    static auto unescape(std::string_view s) -> std::string {
+      auto res = std::string{};
+
+      res.reserve(s.size());
+
+      auto octal = [](char c) { return c >= '0' && c <= '7'; };
+
+      for (std::size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '\\' && i + 3 < s.size() && octal(s[i + 1]) && octal(s[i + 2]) && octal(s[i + 3])) {
+          res.push_back(static_cast<char>((s[i + 1] - '0') << 6 | (s[i + 2] - '0') << 3 | (s[i + 3] - '0')));
+
+          i += 3;
+        }
+        else
+          res.push_back(s[i]);
+      }
+
+      return res;
+    }
+
+    auto cap_of(std::uint64_t dev) const -> std::optional<std::size_t> {
+      if (m_cap)
+        return m_cap;
+
+      static constexpr auto network = std::array<std::string_view, 9>{
+        "nfs", "nfs4", "cifs", "smb3", "smbfs", "ceph", "9p", "afs", "fuse.sshfs",
+      };
+
+      auto it = m_types.find(dev);
+
+      if (it != m_types.end() && std::ranges::find(network, std::string_view{ it->second }) != network.end())
+        return network_cap;
+
+      // a partition has no queue of its own, its disk has
+
+      auto block = std::format("/sys/dev/block/{}:{}", major(dev), minor(dev));
+
+      for (auto* queue : { "/queue/rotational", "/../queue/rotational" }) {
+        auto text = slurp((block + queue).c_str());
+
+        if (!text.empty())
+          return text.starts_with('1') ? std::optional{ rotational_cap } : std::nullopt;
+      }
+
+      return {};
+    }
+
+    std::optional<std::size_t> m_cap;
+
+    std::unordered_map<std::uint64_t, std::string> m_types;
+
+    string_set m_names;
+
+    std::mutex m_mtx;
+
+    std::vector<std::uint64_t> m_devs;
+  };
+
+#endif
+
+  dir_pool m_pool;
+
+  output m_output;
+
+  std::vector<dir_reader> m_readers;
+
+  arena::pool m_blocks;
+
+  std::vector<arena> m_arenas;
+
+  std::vector<scratch> m_scratch;
+
+  // per worker, with io_uring, the directories found in the one it lists
+
+  std::vector<std::vector<job>> m_found;
+
+  // per worker, the directories it found while the pool was crowded, that
+  // it visits itself
+
+  std::vector<std::vector<job>> m_inline;
+
+  std::vector<frame> m_emit_stack;
+
+  std::atomic<std::size_t> m_emit_requests{ 0 };
+
+  // bytes of the listings filled in and not yet written
+
+  std::atomic<std::size_t> m_buffered{ 0 };
+
+  // how many entries have been printed so far, for -limit
+
+  std::atomic<std::size_t> m_limited{ 0 };
+
+  // whether -quit was taken already, without -sorted by evaluating it and
+  // with it by writing it out
+
+  std::atomic<bool> m_quit{ false };
+
+  launcher m_launcher;
+
+  // per worker, then per command
+
+  std::vector<std::vector<command_batch>> m_batches;
+
+  // what arg_limit() leaves of each command for its paths
+
+  std::vector<std::size_t> m_arg_room;
+
+  std::vector<tally> m_tallies;
+
+  std::atomic<bool> m_remove_failed{ false };
+
+#if defined(__linux__)
+  devices m_devices;
+
+  // with -L or --dedup, what the walk went through already
+
+  std::unique_ptr<inode_set> m_seen;
+#endif
+
+  // with walk(), what is handed to the visitor instead of being printed,
+  // per worker
+
+  std::function<void(std::string_view, std::span<const dir_entry>)> m_visitor;
+
+  std::vector<std::vector<dir_entry>> m_visited;
+
+public:
+
+  using visitor = std::function<void(std::string_view dir, std::span<const dir_entry> entries)>;
+
+  finder(params params) noexcept
+    : m_params{ std::move(params) }
+    , m_pool{ m_params.adaptive ? adaptive_size() : m_params.jobs.value_or(dir_pool::default_size()) }
+    , m_output{ m_pool.size() + m_params.sorted, m_params.print0 ? '\0' : '\n' }
+    , m_launcher{ m_pool.size() }
+#if defined(__linux__)
+    , m_devices{ m_params.device_jobs }
+#endif
+  {
+    m_readers.reserve(m_pool.size());
+    m_arenas.reserve(m_pool.size());
+
+    for (std::size_t i = 0; i < m_pool.size(); ++i) {
+#if defined(__linux__)
+      m_readers.emplace_back(m_params.needs(), m_params.io_uring);
+#else
+      m_readers.emplace_back(m_params.needs());
+#endif
+      m_arenas.emplace_back(m_blocks);
+    }
+
+    if (m_params.sorted)
+      m_scratch.resize(m_pool.size());
+
+    m_batches.resize(m_pool.size(), std::vector<command_batch>(m_params.expr.commands().size()));
+
+    if (m_params.totals)
+      m_tallies.resize(m_pool.size());
+
+    auto limit = m_params.expr.commands().empty() ? 0 : launcher::arg_limit();
+
+    for (auto& command : m_params.expr.commands()) {
+      auto bytes = sizeof(char*);
+
+      for (auto& arg : command)
+        bytes += arg.size() + 1 + sizeof(char*);
+
+      m_arg_room.push_back(limit - std::min(bytes, limit / 2));
+    }
+
+    if (m_readers[0].batched())
+      m_found.resize(m_pool.size());
+
+    m_inline.resize(m_pool.size());
+
+#if defined(__linux__)
+    if (m_params.follow || m_params.dedup)
+      m_seen = std::make_unique<inode_set>();
+#endif
+
+    if (m_params.adaptive)
+      m_pool.allow(dir_pool::default_size());
+  }
+
+  static auto make(params params) noexcept -> finder { return std::move(params); }
+
+  static auto from(opts opts)
+    -> std::expected<finder, error_code>
+  {
+    return params::from(opts).transform(make);
+  }
+
+  auto run() noexcept
+    -> std::expected<void, error_code>
+  {
+    if (m_params.paths.empty())
+      return make_unexpected(error_code::path_absent);
+
+    // as find, a root that cannot be walked is reported and left out, the
+    // others are walked all the same and the error returned at the end
+
+    auto unusable = std::optional<error_code::kind>{};
+
+    std::erase_if(m_params.paths, [&](const fs::path& path) {
+      auto kind = !fs::exists(path) ? std::optional{ error_code::path_not_exist }
+        : !fs::is_directory(path) ? std::optional{ error_code::path_not_dir }
+        : std::nullopt;
+
+      if (!kind)
+        return false;
+
+      err("{}: {}", path.string(), error_code{ *kind, std::optional<std::string>{} }.message());
+
+      unusable = unusable.value_or(*kind);
+
+      return true;
+    });
+
+    auto walk_start = std::chrono::steady_clock::now();
+
+    // with -sorted every line goes through the buffer past the workers',
+    // the roots' from a listing of their own that has the listing of each
+    // root below it, in the order they were given
+
+    auto& first = m_output[m_params.sorted ? m_pool.size() : 0];
+
+    auto* top = emits_sorted() ? listing::make(m_arenas[0], 1) : nullptr;
+
+    // the roots are checked here, every other entry by the directory that
+    // lists it
+
+    auto seeds = std::vector<job>{};
+
+    for (auto& path : m_params.paths) {
+      auto& root = path.native();
+
+      auto descend = max_depth() > 0;
+
+      auto prints = std::uint32_t{};
+
+      // as find, the directory it was started from stays
+
+      auto remove = false;
+
+      auto quit = false;
+
+      m_readers[0].top(path, name_of(path), [&](const dir_entry& entry) {
+        if (!unique(entry)) {
+          descend = false;
+
+          return;
+        }
+
+        auto v = verdict_of(entry, 0);
+
+        quit = v.quit;
+
+        descend = descend && !v.prune && !quit && !m_pool.cancelled() && descends(entry);
+
+        remove = v.remove && root != "." && root != "..";
+
+        if (remove && !descend)
+          remove_dir(entry, nullptr, nullptr);
+
+        prints = v.prints;
+
+        if (m_visitor && std::exchange(prints, 0) > 0) {
+          stats::add(stats::matches);
+
+          m_visitor(entry.dir, { &entry, 1 });
+        }
+      });
+
+      auto* out = top && descend ? listing::make(m_arenas[0]) : nullptr;
+
+      for (std::uint32_t i = 0; i < prints; ++i) {
+        stats::add(stats::matches);
+
+        if (top) {
+          m_scratch[0].lines.append(root);
+          m_scratch[0].lines.push_back(m_params.print0 ? '\0' : '\n');
+        }
+        else
+          first.append(root);
+      }
+
+      if (top)
+        m_scratch[0].items.push_back({ m_scratch[0].lines.size(), prints, out, quit });
+
+      if (descend) {
+        auto* node = dir_node::make(m_arenas[0], root, {}, nullptr, 0);
+
+        auto d = device_at(node->c_str());
+
+        node->place(d.dev, d.lane);
+
+        if (remove)
+          node->remove_later(nullptr);
+
+        if (out)
+          assign(*out, node);
+
+        seeds.push_back({ node, out });
+      }
+    }
+
+    auto indexed = true;
+
+    auto monitor = m_params.progress || m_params.adaptive
+      ? std::jthread{ [this, walk_start](std::stop_token stop) { watch(stop, walk_start); } }
+      : std::jthread{};
+
+#if defined(__linux__)
+    if (m_params.index || m_params.index_build) {
+      if (!seeds.empty())
+        indexed = walk_indexed(m_params.paths[0].native(), first);
+
+      for (auto& j : seeds) {
+        settle(j.node, !m_pool.cancelled());
+
+        dir_node::unref(j.node);
+      }
+    }
+    else
+#endif
+    {
+      if (top) {
+        fill(*top, m_arenas[0], m_scratch[0]);
+
+        m_buffered.fetch_add(top->size(), std::memory_order_relaxed);
+
+        m_emit_stack.push_back({ top, 0, 0 });
+
+        top->ready.store(true, std::memory_order_release);
+      }
+
+      for (auto& j : by_device(std::move(seeds)))
+        visit(j);
+
+      // walk the trees on the pool, it returns once every directory is visited
+
+      m_pool.run([this](job j) { run_visit(j); run_inline(j); });
+
+      if (top)
+        emit();
+
+      if (m_pool.cancelled())
+        drop_walk();
+    }
+
+    monitor = {};
+
+    auto [ran, removed] = finish_actions();
+
+    if (m_params.totals)
+      write_totals(first);
+
+    auto walk_end = std::chrono::steady_clock::now();
+
+    auto written = m_output.close();
+
+    if (m_params.stats)
+      report(*m_params.stats, { walk_start - started, walk_end - walk_start, std::chrono::steady_clock::now() - walk_end });
+
+    if (!written)
+      return make_unexpected(error_code::write_failed);
+
+    if (!indexed)
+      return make_unexpected(error_code::index_failed);
+
+    if (!ran)
+      return make_unexpected(error_code::exec_failed);
+
+    if (!removed)
+      return make_unexpected(error_code::delete_failed);
+
+    if (unusable)
+      return make_unexpected(*unusable, "Some of the paths could not be walked!");
+
+    return {};
+  }
+
+  // the same as run() but for what would be printed, which is handed to fn
+  // instead: the entries a directory matches with, a buffer of its listing
+  // at a time, from the worker reading it and so concurrently for separate
+  // directories. They are only valid until fn returns, their metadata is
+  // fetched if and when asked for. With no lines there is nothing for
+  // -sorted to order, nor totals to print them with, and an index walk has
+  // no directory to fetch metadata from.
+
+  auto walk(visitor fn) noexcept
+    -> std::expected<void, error_code>
+  {
+    if (m_params.sorted || m_params.totals || m_params.index || m_params.index_build)
+      return make_unexpected(error_code::invalid_arg);
+
+    m_visitor = std::move(fn);
+
+    m_visited.resize(m_pool.size());
+
+    return run();
+  }
+
+  // end the walk early from any thread, as -quit would
+
+  void stop() noexcept { m_pool.cancel(); }
+
+  // whether an entry passes the filters, public so that it can be timed alone
+
+  bool shall_print(const dir_entry& entry) const noexcept { return m_params.expr.eval(entry).prints > 0; }
+
+private:
+
+  static inline const auto started = std::chrono::steady_clock::now();
+
+  // wall time from the start of the process to the walk, of the walk and of
+  // the final output flush
+
+  using phases = std::array<std::chrono::steady_clock::duration, 3>;
+
+  void report(stats_format format, const phases& times) const {
+    constexpr std::string_view phase_names[] = { "start", "walk", "flush" };
+
+    auto values = stats::total();
+
+    auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+    auto out = std::string{};
+
+    if (format == stats_format::json) {
+      out += "{";
+
+      for (std::size_t c = 0; c < stats::counter_count; ++c)
+        out += std::format("\"{}\":{},", stats::name(static_cast<stats::counter>(c)), values[c]);
+
+      out += std::format("\"queue_high_water\":{},\"threads\":{},\"time_ms\":{{", m_pool.high_water(), m_pool.size());
+
+      for (std::size_t i = 0; i < times.size(); ++i)
+        out += std::format("{}\"{}\":{:.3f}", i ? "," : "", phase_names[i], ms(times[i]));
+
+      out += "}}\n";
+    }
+    else {
+      for (std::size_t c = 0; c < stats::counter_count; ++c)
+        out += std::format("{:<18}{}\n", stats::name(static_cast<stats::counter>(c)), values[c]);
+
+      out += std::format("{:<18}{}\n", "queue_high_water", m_pool.high_water());
+      out += std::format("{:<18}{}\n", "threads", m_pool.size());
+
+      for (std::size_t i = 0; i < times.size(); ++i)
+        out += std::format("{:<18}{:.3f} ms\n", std::format("time_{}", phase_names[i]), ms(times[i]));
+    }
+
+    std::cerr << out;
+  }
+
+  // with -j auto, as many workers as the walk may grow to
+
+  static auto adaptive_size() noexcept -> std::size_t { return std::max<std::size_t>(4 * dir_pool::default_size(), 16); }
+
+  static inline std::atomic<bool> s_signalled{ false };
+
+  static void on_signal(int) noexcept { s_signalled.store(true, std::memory_order_relaxed); }
+
+  // for --progress and -j auto, until stop: the counters of the workers are
+  // sampled every second, and on SIGUSR1, reported with --progress, and
+  // with -j auto turned into how many workers may run. Those are judged by
+  // how much of their time goes to system calls against how much CPU the
+  // process gets: a walk waiting on disks or network gains from more
+  // requests in flight, one that keeps the cores busy only contends more.
+
+  void watch(std::stop_token stop, std::chrono::steady_clock::time_point start) {
+    static constexpr auto tick = std::chrono::milliseconds{ 100 };
+
+    static constexpr std::size_t ticks_per_sample = 10;
+
+    stats::time_syscalls(true);
+
+#if !defined(_WIN32)
+    struct sigaction sa = {}, old = {};
+
+    if (m_params.progress) {
+      sa.sa_handler = on_signal;
+      sa.sa_flags = SA_RESTART;
+
+      sigemptyset(&sa.sa_mask);
+
+      ::sigaction(SIGUSR1, &sa, &old);
+    }
+#endif
+
+    auto mtx = std::mutex{};
+
+    auto cv = std::condition_variable_any{};
+
+    auto lck = std::unique_lock{ mtx };
+
+    auto last_at = start;
+
+    auto last = stats::total();
+
+    auto last_cpu = std::clock();
+
+    for (std::size_t n = 1;; ++n) {
+      cv.wait_for(lck, stop, tick, []() { return false; });
+
+      if (stop.stop_requested())
+        break;
+
+      auto sample = n % ticks_per_sample == 0;
+
+      auto signalled = s_signalled.exchange(false, std::memory_order_relaxed);
+
+      if (!sample && !signalled)
+        continue;
+
+      auto now = std::chrono::steady_clock::now();
+
+      auto values = stats::total();
+
+      auto cpu_now = std::clock();
+
+      auto secs = std::chrono::duration<double>(now - last_at).count();
+
+      // how many cores the process kept busy
+
+      auto cpu = secs > 0 ? static_cast<double>(cpu_now - last_cpu) / CLOCKS_PER_SEC / secs : 0.0;
+
+      if (m_params.progress && (signalled || *m_params.progress == progress_mode::periodic))
+        report_progress(std::chrono::duration<double>(now - start).count(), secs, cpu, last, values);
+
+      if (!sample)
+        continue;
+
+      if (m_params.adaptive)
+        tune(blocked(secs, last, values), cpu);
+
+      last_at = now;
+      last = values;
+      last_cpu = cpu_now;
+    }
+
+#if !defined(_WIN32)
+    if (m_params.progress)
+      ::sigaction(SIGUSR1, &old, nullptr);
+#endif
+
+    stats::time_syscalls(false);
+  }
+
+  // how many workers are in system calls on average over secs
+
+  static auto blocked(double secs, const stats::values& before, const stats::values& after) noexcept -> double {
+    return secs > 0 ? static_cast<double>(after[stats::syscall_ns] - before[stats::syscall_ns]) / 1e9 / secs : 0.0;
+  }
+
+  void report_progress(double elapsed, double secs, double cpu, const stats::values& before, const stats::values& after) const {
+    auto rate = [&](stats::counter c) { return secs > 0 ? static_cast<double>(after[c] - before[c]) / secs : 0.0; };
+
+    std::cerr << std::format(
+      "progress {:.1f}s: {} dirs ({:.0f}/s), {} entries ({:.0f}/s), {} matches, queue {}, {}/{} workers active, {:.1f} in system calls, {:.1f} cores busy\n",
+      elapsed,
+      after[stats::dirs_opened], rate(stats::dirs_opened),
+      after[stats::entries], rate(stats::entries),
+      after[stats::matches],
+      m_pool.queued(),
+      m_pool.active(), m_pool.allowed(),
+      blocked(secs, before, after),
+      cpu);
+  }
+
+  // the cores all busy, or hardly any worker waiting on the kernel: those
+  // past one per core only take turns on them, allow one less. More than
+  // half waiting with the cores to spare, and jobs queued for more: allow a
+  // quarter more.
+
+  void tune(double busy, double cpu) noexcept {
+    auto allowed = m_pool.allowed();
+
+    auto cores = dir_pool::default_size();
+
+    auto bound = cpu > 0.9 * static_cast<double>(cores) || busy * 4 < static_cast<double>(allowed);
+
+    if (bound && allowed > cores)
+      m_pool.allow(allowed - 1);
+    else if (!bound && busy * 2 > static_cast<double>(allowed) && m_pool.queued() > allowed)
+      m_pool.allow(allowed + std::max<std::size_t>(allowed / 4, 1));
+  }
+
+  // the filename component of a path, as a view into it
+
+  static auto name_of(const fs::path& path) noexcept -> std::string_view {
+    auto s = std::basic_string_view{ path.native() };
+
+    return s.substr(s.find_last_of(fs::path::preferred_separator) + 1);
+  }
+
+  inline auto max_depth() const noexcept -> std::size_t { return m_params.maxdepth.value_or(SIZE_MAX); }
+
+  // past this many jobs queued, enough to keep every worker busy stealing,
+  // more would only hold on to the nodes of a whole level of a wide tree
+
+  static constexpr std::size_t default_pending = 1 << 16;
+
+  inline auto crowded() const noexcept -> bool {
+    return m_pool.queued() >= m_params.max_pending.value_or(default_pending);
+  }
+
+  // the expression is not even evaluated above -mindepth
+
+  inline auto verdict_of(const dir_entry& entry, std::size_t depth) noexcept -> expression::verdict {
+    if (depth < m_params.mindepth.value_or(0))
+      return {};
+
+    auto v = m_params.expr.eval(entry);
+
+    // -quit is taken once. With -sorted it is where the output gets to
+    // first, see emit(). Otherwise it is the first entry to evaluate it:
+    // what any other, or whatever comes after, would have done is dropped,
+    // as its worker may not have seen the walk cancelled yet.
+
+    if (!emits_sorted() && (v.quit ? m_quit.exchange(true, std::memory_order_acq_rel) : m_quit.load(std::memory_order_relaxed)))
+      return { .prune = true };
+
+    if (m_params.limit && v.prints > 0 && !emits_sorted())
+      v.prints = limited(v.prints);
+
+    if (v.execs || v.remove)
+      act(entry, v);
+
+    if (v.quit && !emits_sorted())
+      m_pool.cancel();
+
+    // with totals nothing is printed, what would be is added up instead
+
+    if (!m_tallies.empty() && v.prints > 0)
+      add_up(entry, depth, std::exchange(v.prints, 0));
+
+    return v;
+  }
+
+  void add_up(const dir_entry& entry, std::size_t depth, std::uint32_t prints) {
+    auto& t = m_tallies[m_pool.index()];
+
+    stats::add(stats::matches, prints);
+
+    t.count += prints;
+
+    if (*m_params.totals == aggregate::by_ext && entry.type() == fs::file_type::regular) {
+      auto dot = entry.name.find_last_of('.');
+
+      auto ext = dot == std::string_view::npos || dot == 0 ? std::string_view{} : entry.name.substr(dot + 1);
+
+      auto it = t.exts.find(ext);
+
+      if (it == t.exts.end())
+        it = t.exts.emplace(ext, ext_total{}).first;
+
+      it->second.count += prints;
+      it->second.bytes += prints * entry.meta().size;
+    }
+
+    if (*m_params.totals == aggregate::du) {
+      auto& tops = depth == 0 ? t.roots : t.tops;
+
+      auto top = top_of(entry, depth);
+
+      auto it = tops.find(top);
+
+      if (it == tops.end())
+        it = tops.emplace(std::move(top), 0).first;
+
+      it->second += prints * entry.meta().size;
+    }
+  }
+
+  // the path of the entry of its root that entry is, or is below, the
+  // root itself for the root: its directory less as many components as
+  // it is deeper than that
+
+  static auto top_of(const dir_entry& entry, std::size_t depth) -> std::string {
+    if (depth <= 1)
+      return std::string{ depth == 0 ? entry.dir : expression::path_of(entry) }
+        + std::string{ depth == 0 ? entry.name : std::string_view{} };
+
+    auto dir = entry.dir;
+
+    for (auto k = depth; k > 2; --k)
+      dir = dir.substr(0, dir.find_last_of('/'));
+
+    return std::string{ dir };
+  }
+
+  // the totals of every worker, merged and written out: a count, a line
+  // of extension, count and bytes for every extension from the most bytes
+  // down, or a line of bytes and path for every entry of the root and then
+  // the root, as du -s does
+
+  void write_totals(output::buffer& out) {
+    auto all = tally{};
+
+    for (auto& t : m_tallies) {
+      all.count += t.count;
+
+      for (auto& [ext, e] : t.exts) {
+        all.exts[ext].count += e.count;
+        all.exts[ext].bytes += e.bytes;
+      }
+
+      for (auto& [top, bytes] : t.tops)
+        all.tops[top] += bytes;
+
+      for (auto& [root, bytes] : t.roots)
+        all.roots[root] += bytes;
+    }
+
+    switch (*m_params.totals) {
+
+    case aggregate::count:
+      out.append(std::format("{}", all.count));
+
+      break;
+
+    case aggregate::by_ext: {
+      auto exts = std::vector<std::pair<std::string, ext_total>>{ all.exts.begin(), all.exts.end() };
+
+      std::ranges::sort(exts, [](auto& a, auto& b) { return a.second.bytes != b.second.bytes ? a.second.bytes > b.second.bytes : a.first < b.first; });
+
+      for (auto& [ext, e] : exts)
+        out.append(std::format("{}\t{}\t{}", ext.empty() ? "(none)" : ext, e.count, e.bytes));
+
+      break;
+    }
+
+    case aggregate::du: {
+      auto tops = std::vector<std::pair<std::string, std::uint64_t>>{ all.tops.begin(), all.tops.end() };
+
+      std::ranges::sort(tops);
+
+      for (auto& path : m_params.paths) {
+        auto& root = path.native();
+
+        auto total = all.roots[root];
+
+        for (auto& [top, bytes] : tops) {
+          auto name = std::string_view{ top };
+
+          if (!name.starts_with(root))
+            continue;
+
+          name.remove_prefix(root.size());
+
+          if (!root.ends_with('/') && !name.starts_with('/'))
+            continue;
+
+          name.remove_prefix(root.ends_with('/') ? 0 : 1);
+
+          if (name.empty() || name.find('/') != std::string_view::npos)
+            continue;
+
+          total += bytes;
+
+          out.append(std::format("{}\t{}", bytes, top));
+        }
+
+        out.append(std::format("{}\t{}", total, root));
+      }
+
+      break;
+    }
+    }
+  }
+
+  // the roots in an order where consecutive ones are on different devices
+  // as much as they can be, so that the workers taking them first do not
+  // all start on the same disk
+
+  static auto by_device(std::vector<job> seeds) -> std::vector<job> {
+    auto devs = std::vector<std::pair<std::uint64_t, std::vector<job>>>{};
+
+    for (auto& j : seeds) {
+      auto dev = j.node->dev();
+
+      auto it = std::ranges::find(devs, dev, [](auto& d) { return d.first; });
+
+      if (it == devs.end())
+        it = devs.insert(devs.end(), { dev, {} });
+
+      it->second.push_back(j);
+    }
+
+    seeds.clear();
+
+    for (std::size_t k = 0;; ++k) {
+      auto any = false;
+
+      for (auto& [dev, jobs] : devs)
+        if (k < jobs.size()) {
+          seeds.push_back(jobs[k]);
+
+          any = true;
+        }
+
+      if (!any)
+        break;
+    }
+
+    return seeds;
+  }
+
+  // with -sorted, lay the lines and items of scratch out in one block of
+  // arena for l, and clear them
+
+  static void fill(listing& l, arena& arena, scratch& scratch) {
+    auto& [names, entries, lines, items] = scratch;
+
+    if (!items.empty()) {
+      auto bytes = items.size() * sizeof(listing::item);
+
+      l.block = arena.allocate(bytes + lines.size());
+
+      auto* p = static_cast<char*>(l.block);
+
+      std::memcpy(p, items.data(), bytes);
+      std::memcpy(p + bytes, lines.data(), lines.size());
+
+      l.items = { reinterpret_cast<const listing::item*>(p), items.size() };
+      l.text = { p + bytes, lines.size() };
+    }
+
+    names.clear();
+    entries.clear();
+    lines.clear();
+    items.clear();
+  }
+
+  // after -quit or -limit, give back what the walk left: the directories
+  // never visited and, with -sorted, the listings never written
+
+  void drop_walk() {
+    m_pool.drain([this](job& j) { drop(j); });
+
+    for (auto& f : m_emit_stack) {
+      for (auto k = f.item; k < f.l->items.size(); ++k)
+        if (f.l->items[k].child)
+          drop_listing(f.l->items[k].child);
+
+      listing::unref(f.l);
+    }
+
+    m_emit_stack.clear();
+  }
+
+  static void drop_listing(listing* l) noexcept {
+    for (auto& it : l->items)
+      if (it.child)
+        drop_listing(it.child);
+
+    listing::unref(l);
+  }
+
+  // with -sorted, l is what the job of node fills in
+
+  static void assign(listing& l, dir_node* node) noexcept {
+    l.node = node;
+    l.lane = node->lane();
+  }
+
+  // whether j is the one to visit its directory, with -sorted the first of
+  // the two it may be queued as; the other only lets the listing go
+
+  static auto claim(job j) noexcept -> bool {
+    if (!j.out || !j.out->claimed.exchange(true, std::memory_order_acq_rel))
+      return true;
+
+    listing::unref(j.out);
+
+    return false;
+  }
+
+  // give back a job that will not be run
+
+  void drop(job j) noexcept {
+    if (!claim(j))
+      return;
+
+    settle(j.node, false);
+
+    dir_node::unref(j.node);
+
+    if (j.out)
+      listing::unref(j.out);
+  }
+
+  // whether the lines go out through emit(), in order, and are counted
+  // there for -limit: with -sorted, but for the index walk that is in
+  // order already
+
+  inline auto emits_sorted() const noexcept -> bool {
+#if defined(__linux__)
+    return m_params.sorted && !m_params.index && !m_params.index_build;
+#else
+    return m_params.sorted;
+#endif
+  }
+
+  // how many of prints are left to print before -limit, the walk
+  // cancelled once it is reached
+
+  auto limited(std::uint32_t prints) noexcept -> std::uint32_t {
+    auto limit = *m_params.limit;
+
+    auto before = m_limited.fetch_add(prints, std::memory_order_relaxed);
+
+    if (before + prints >= limit)
+      m_pool.cancel();
+
+    return before >= limit ? 0 : static_cast<std::uint32_t>(std::min<std::size_t>(prints, limit - before));
+  }
+
+  // what the verdict asks for besides printing and pruning: the path of
+  // entry gathered for the commands of its -exec, and entry removed for
+  // -delete, but for a directory: the one that lists it has it removed
+  // once walked, through remove_dir()
+
+  void act(const dir_entry& entry, const expression::verdict& v) {
+    auto w = m_pool.index();
+
+    auto path = expression::path_of(entry);
+
+    for (auto bits = v.execs; bits; bits &= bits - 1)
+      gather(m_batches[w][std::countr_zero(bits)], std::countr_zero(bits), path);
+
+    if (v.remove && entry.type() != fs::file_type::directory)
+      removed(entry.remove(false));
+  }
+
+  inline void removed(bool ok) noexcept {
+    if (ok)
+      stats::add(stats::deleted);
+    else
+      m_remove_failed.store(true, std::memory_order_relaxed);
+  }
+
+  // with -delete, a directory that is walked as node, found in the one of
+  // up, is removed once node is done with, after everything below it;
+  // one that is not walked is removed right away
+
+  void remove_dir(const dir_entry& entry, dir_node* node, dir_node* up) {
+    if (node)
+      node->remove_later(up);
+    else
+      removed(entry.remove(true));
+  }
+
+  // a node is done with, walked or not: once it is the last thing its
+  // removal waits for, it is removed, and so on up to the first directory
+  // that still waits for something else. One that was not entirely walked
+  // stays, as do those it is in.
+
+  void settle(dir_node* node, bool walked = true) {
+    if (!node->removing())
+      return;
+
+    auto* held = static_cast<dir_node*>(nullptr);
+
+    while (node && node->settle(walked)) {
+      walked = !node->spared();
+
+      if (walked)
+        removed(node->remove());
+
+      auto* up = node->take_up();
+
+      // the reference on node, from below, goes once through with it
+
+      if (held)
+        dir_node::unref(held);
+
+      held = up;
+
+      node = up && up->removing() ? up : nullptr;
+    }
+
+    if (held)
+      dir_node::unref(held);
+  }
+
+  // add path to a batch, running the batch first if the command would
+  // take too many arguments with it
+
+  void gather(command_batch& b, std::size_t c, std::string_view path) {
+    auto bytes = path.size() + 1 + sizeof(char*);
+
+    if (b.count > 0 && b.bytes + bytes > m_arg_room[c])
+      run_batch(b, c);
+
+    b.paths.append(path);
+    b.paths.push_back('\0');
+
+    ++b.count;
+
+    b.bytes += bytes;
+  }
+
+  void run_batch(command_batch& b, std::size_t c) {
+    auto argv = std::vector<char*>{};
+
+    argv.reserve(m_params.expr.commands()[c].size() + b.count + 1);
+
+    for (auto& arg : m_params.expr.commands()[c])
+      argv.push_back(const_cast<char*>(arg.c_str()));
+
+    for (std::size_t at = 0; at < b.paths.size(); at = b.paths.find('\0', at) + 1)
+      argv.push_back(b.paths.data() + at);
+
+    argv.push_back(nullptr);
+
+    m_launcher.spawn(argv.data());
+
+    b.paths.clear();
+    b.count = 0;
+    b.bytes = 0;
+  }
+
+  // once the walk is over: the batches left run and waited for; false if
+  // a command failed, and the same for -delete
+
+  auto finish_actions() -> std::pair<bool, bool> {
+    for (auto& batches : m_batches)
+      for (std::size_t c = 0; c < batches.size(); ++c)
+        if (batches[c].count > 0)
+          run_batch(batches[c], c);
+
+    auto ran = m_launcher.wait();
+
+    return { ran, !m_remove_failed.load(std::memory_order_relaxed) };
+  }
+
+  // print entry, depth levels below the root, if it passes; false if what
+  // is below it is pruned
+
+  // whether evaluating entry stats it, for the listing to batch that
+
+  inline auto will_stat(const dir_entry& entry, std::size_t depth) const noexcept -> bool {
+    return depth >= m_params.mindepth.value_or(0) && m_params.expr.will_stat(entry, m_params.sizes());
+  }
+
+  inline auto print_entry(const dir_entry& entry, std::size_t depth) noexcept -> expression::verdict {
+    auto v = verdict_of(entry, depth);
+
+    if (m_visitor) {
+      if (v.prints > 0) {
+        stats::add(stats::matches);
+
+        m_visited[m_pool.index()].push_back(entry);
+      }
+
+      return v;
+    }
+
+    for (std::uint32_t i = 0; i < v.prints; ++i) {
+      stats::add(stats::matches);
+
+      m_output[m_pool.index()].append(entry.dir, entry.name);
+    }
+
+    return v;
+  }
+
+  // with walk(), hand what a buffer of the listing of dir matched with
+  // over to the visitor, while the entries are still valid
+
+  void hand_over(std::string_view dir) {
+    if (!m_visitor)
+      return;
+
+    auto& visited = m_visited[m_pool.index()];
+
+    if (visited.empty())
+      return;
+
+    m_visitor(dir, visited);
+
+    visited.clear();
+  }
+
+  inline void visit(job j) { queue_visit(j); }
+
+  // the device of the directory at path and its lane, whose cap is set the
+  // first time the device is seen
+
+  auto device_at(const char* path) -> device {
+#if defined(__linux__)
+    struct stat st;
+
+    if (::stat(path, &st) != 0)
+      return {};
+
+    return device_on(st.st_dev);
+#else
+    return {};
+#endif
+  }
+
+#if defined(__linux__)
+
+  auto device_on(std::uint64_t dev) -> device {
+    auto [lane, cap] = m_devices.lane(dev);
+
+    if (cap)
+      m_pool.limit(lane, *cap);
+
+    return { dev, lane };
+  }
+
+#endif
+
+  // the device of a directory found in parent, the one of parent but for a
+  // mount point, or with -L what it was stated on; nullopt where -xdev
+  // keeps the walk out of it
+
+  auto device_of(const dir_entry& entry, const dir_node& parent) -> std::optional<device> {
+    auto same = device{ parent.dev(), static_cast<std::uint16_t>(parent.lane()) };
+
+#if defined(__linux__)
+    if (m_params.follow ? entry.meta().dev == parent.dev() : !m_devices.may_mount(entry.name))
+      return same;
+
+    auto d = m_params.follow
+      ? device_on(entry.meta().dev)
+      : device_at(std::string{ expression::path_of(entry) }.c_str());
+
+    if (d.dev == 0 || d.dev == parent.dev())
+      return same;
+
+    if (m_params.xdev)
+      return {};
+
+    return d;
+#else
+    return same;
+#endif
+  }
+
+  // with -L or --dedup, false for what was met already under another path:
+  // the directory of a loop, or one that is bind mounted twice, or with
+  // --dedup a file of several links
+
+  auto first_time(const dir_entry& entry) -> bool {
+#if defined(__linux__)
+    auto& meta = entry.meta();
+
+    return meta.ino == 0 || m_seen->insert(meta.dev, meta.ino);
+#else
+    return true;
+#endif
+  }
+
+  // whether entry is to be evaluated at all: with --dedup, only the first
+  // path met of a directory or a file of several links is
+
+  inline auto unique(const dir_entry& entry) -> bool {
+    if (!m_params.dedup)
+      return true;
+
+    if (entry.type() != fs::file_type::directory && entry.meta().nlink < 2)
+      return true;
+
+    return first_time(entry);
+  }
+
+  // whether to descend into a directory, with -L only the first time it is
+  // met; with --dedup unique() told already
+
+  inline auto descends(const dir_entry& entry) -> bool {
+    return !m_params.follow || m_params.dedup || first_time(entry);
+  }
+
+  // the node of a directory found in parent, on its device
+
+  static auto node_of(arena& arena, const dir_entry& entry, dir_node* shared, std::size_t depth, device d) -> dir_node* {
+    auto* node = dir_node::make(arena, entry.dir, entry.name, shared, depth);
+
+    node->place(d.dev, d.lane);
+
+    return node;
+  }
+
+  void queue_visit(job j) { m_pool.push(j); }
+
+  // a directory found while listing another, queued right away or, with
+  // io_uring, once the listing is done and it is opened together with the
+  // others found there
+
+  inline void found(job j) {
+    if (crowded())
+      return m_inline[m_pool.index()].push_back(j);
+
+    if (m_found.empty())
+      return visit(j);
+
+    m_found[m_pool.index()].push_back(j);
+  }
+
+  void queue_found() {
+    if (m_found.empty())
+      return;
+
+    auto& found = m_found[m_pool.index()];
+
+    m_readers[m_pool.index()].prefetch(found | std::views::transform(&job::node));
+
+    for (auto& j : found)
+      visit(j);
+
+    found.clear();
+  }
+
+  // once done with a job, visit what was kept off the crowded pool while
+  // it ran, newest first: the walk goes depth-first below it, and what is
+  // found meanwhile is queued again as soon as the pool has room for it.
+  // While the pool is held for -sorted it is all queued, to wait there.
+  // Only those on the lane of the job that ran, whose slot is still held,
+  // go straight on: others take a slot of their own lane, or are queued
+  // when it has none left.
+
+  void run_inline(const job& ran) {
+    auto& stack = m_inline[m_pool.index()];
+
+    while (!stack.empty()) {
+      auto j = stack.back();
+
+      stack.pop_back();
+
+      if (m_pool.cancelled())
+        drop(j);
+      else if (m_pool.held())
+        queue_visit(j);
+      else if (dir_pool::lane_of(j) == dir_pool::lane_of(ran))
+        run_visit(j);
+      else if (m_pool.enter(j)) {
+        run_visit(j);
+
+        m_pool.leave(j);
+      }
+      else
+        queue_visit(j);
+    }
+  }
+
+  // list a directory, printing what matches and queueing the directories
+  // found in it unless pruned or at -maxdepth, so that they are never even
+  // opened; symlinks are listed but never followed
+
+  void run_visit(job j) {
+    if (j.out)
+      return run_visit_sorted(j);
+
+    auto& arena = m_arenas[m_pool.index()];
+
+    auto depth = j.node->depth() + 1;
+
+    auto deeper = depth < max_depth();
+
+    auto read = m_readers[m_pool.index()].read(*j.node, [&](const dir_entry& entry, auto&& share) {
+      if (m_pool.cancelled() || !unique(entry))
+        return;
+
+      auto v = print_entry(entry, depth);
+
+      auto d = !v.prune && deeper && entry.type() == fs::file_type::directory && descends(entry)
+        ? device_of(entry, *j.node)
+        : std::nullopt;
+
+      auto* node = d ? node_of(arena, entry, share(), depth, *d) : nullptr;
+
+      if (v.remove && entry.type() == fs::file_type::directory)
+        remove_dir(entry, node, j.node);
+
+      if (node)
+        found({ node, nullptr });
+    }, [&](const dir_entry& entry) { return will_stat(entry, depth); }, [&]() { hand_over(j.node->path()); });
+
+    queue_found();
+
+    // a directory swapped for a symlink since is left, and so is what it
+    // is in
+
+    settle(j.node, read != listing_of::gone);
+
+    dir_node::unref(j.node);
+  }
+
+  // the same into the listing of the job: entries are kept until the
+  // directory is read, then sorted by name and their lines written out,
+  // every directory queued with a listing of its own in its item
+
+  void run_visit_sorted(job j) {
+    if (!claim(j))
+      return;
+
+    auto& arena = m_arenas[m_pool.index()];
+
+    auto& [names, entries, lines, items] = m_scratch[m_pool.index()];
+
+    auto depth = j.node->depth() + 1;
+
+    auto deeper = depth < max_depth();
+
+    auto read = m_readers[m_pool.index()].read(*j.node, [&](const dir_entry& entry, auto&& share) {
+      if (m_pool.cancelled() || !unique(entry))
+        return;
+
+      auto v = verdict_of(entry, depth);
+
+      auto* child = static_cast<listing*>(nullptr);
+
+      auto d = !v.prune && !v.quit && deeper && entry.type() == fs::file_type::directory && descends(entry)
+        ? device_of(entry, *j.node)
+        : std::nullopt;
+
+      auto* node = d ? node_of(arena, entry, share(), depth, *d) : nullptr;
+
+      if (v.remove && entry.type() == fs::file_type::directory)
+        remove_dir(entry, node, j.node);
+
+      if (node) {
+        child = listing::make(arena);
+
+        assign(*child, node);
+
+        found({ node, child });
+      }
+
+      if (v.prints == 0 && !child && !v.quit)
+        return;
+
+      entries.push_back({ names.size(), entry.name.size(), v.prints, child, v.quit });
+
+      names.append(entry.name);
+    }, [&](const dir_entry& entry) { return will_stat(entry, depth); });
+
+    queue_found();
+
+    auto name = [&](const pending& e) { return std::string_view{ names }.substr(e.at, e.size); };
+
+    std::ranges::sort(entries, {}, name);
+
+    auto dir = j.node->path();
+
+    auto end = m_params.print0 ? '\0' : '\n';
+
+    for (auto& e : entries) {
+      for (std::uint32_t i = 0; i < e.prints; ++i) {
+        stats::add(stats::matches);
+
+        lines.append(dir);
+
+        if (!dir.ends_with('/'))
+          lines.push_back('/');
+
+        lines.append(name(e));
+        lines.push_back(end);
+      }
+
+      items.push_back({ lines.size(), e.prints, e.child, e.quit });
+    }
+
+    auto& out = *j.out;
+
+    fill(out, arena, m_scratch[m_pool.index()]);
+
+    m_buffered.fetch_add(out.size(), std::memory_order_relaxed);
+
+    settle(j.node, read != listing_of::gone);
+
+    dir_node::unref(j.node);
+
+    out.ready.store(true, std::memory_order_release);
+
+    listing::unref(&out);
+
+    emit();
+  }
+
+#if defined(__linux__)
+
+  // a directory of the walk with --index, listed, and how far along its
+  // entries the walk is
+
+  struct level {
+    struct item {
+      std::size_t at;
+      std::size_t size;
+      fs::file_type type;
+    };
+
+    std::string dir;
+
+    std::string names;
+
+    std::vector<item> items;
+
+    std::size_t next = 0;
+
+    std::size_t depth = 0; // of the entries
+
+    bool remove = false; // with -delete, once walked
+
+    inline auto name(const item& i) const noexcept -> std::string_view { return std::string_view{ names }.substr(i.at, i.size); }
+  };
+
+  // with --index or --index-build, walk depth first on this thread, the
+  // entries of every directory by name. A directory that still has the
+  // mtime the index records for it is listed from the index at the cost of
+  // a stat, every other one is read; with --index-build every directory
+  // listed is recorded into a new index. False if that one could not be
+  // written.
+
+  auto walk_indexed(const std::string& root, output::buffer& out) -> bool {
+    auto& from = m_params.index ? *m_params.index : *m_params.index_build;
+
+    auto old = path_index::reader::open(from.c_str());
+
+    if (old && old->root() != root)
+      old.reset();
+
+    auto fresh = m_params.index_build ? path_index::writer::create(*m_params.index_build, root) : std::nullopt;
+
+    if (m_params.index_build && !fresh)
+      return false;
+
+    auto recorded = std::vector<path_index::entry>{};
+
+    auto list = [&](level& l) {
+      l.names.clear();
+      l.items.clear();
+      l.next = 0;
+
+      auto add = [&](std::string_view name, fs::file_type type) {
+        l.items.push_back({ l.names.size(), name.size(), type });
+        l.names.append(name);
+      };
+
+      struct stat st;
+
+      stats::add(stats::stat_calls);
+
+      if (::stat(l.dir.c_str(), &st) != 0)
+        return;
+
+      auto mtime = st.st_mtim.tv_sec * 1'000'000'000LL + st.st_mtim.tv_nsec;
+
+      auto reused = old && old->seek(l.dir) && old->mtime() == mtime && old->entries([&](const path_index::entry& e) {
+        stats::add(stats::entries);
+
+        add(e.name, e.type);
+      });
+
+      if (!reused) {
+        l.names.clear();
+        l.items.clear();
+
+        auto* node = dir_node::make(m_arenas[0], l.dir, {}, nullptr, 0);
+
+        m_readers[0].read(*node, [&](const dir_entry& e, auto&&) { add(e.name, e.type()); });
+
+        dir_node::unref(node);
+
+        std::ranges::sort(l.items, {}, [&](const level::item& i) { return l.name(i); });
+      }
+
+      if (!fresh)
+        return;
+
+      recorded.clear();
+
+      for (auto& i : l.items)
+        recorded.push_back({ l.name(i), i.type });
+
+      fresh->add(l.dir, mtime, recorded);
+    };
+
+    // levels are reused as the walk goes down and up again
+
+    auto levels = std::vector<level>(1);
+
+    auto top = std::size_t{ 0 };
+
+    levels[0].dir = root;
+    levels[0].depth = 1;
+
+    list(levels[0]);
+
+    auto path = std::string{};
+
+    while (!m_pool.cancelled()) {
+      auto& l = levels[top];
+
+      if (l.next == l.items.size()) {
+        if (top == 0)
+          break;
+
+        if (l.remove)
+          removed(::rmdir(l.dir.c_str()) == 0);
+
+        --top;
+
+        continue;
+      }
+
+      auto& i = l.items[l.next++];
+
+      auto name = l.name(i);
+
+      path.assign(l.dir);
+
+      if (!l.dir.ends_with('/'))
+        path.push_back('/');
+
+      path.append(name);
+
+      auto entry = dir_entry{ l.dir, name, AT_FDCWD, path.c_str(), i.type, m_params.needs() };
+
+      auto v = verdict_of(entry, l.depth);
+
+      for (std::uint32_t k = 0; k < v.prints; ++k) {
+        stats::add(stats::matches);
+
+        out.append(l.dir, name);
+      }
+
+      if (entry.type() != fs::file_type::directory)
+        continue;
+
+      if (v.prune || l.depth >= max_depth()) {
+        if (v.remove)
+          remove_dir(entry, nullptr, nullptr);
+
+        continue;
+      }
+
+      auto depth = l.depth + 1;
+
+      if (++top == levels.size())
+        levels.emplace_back();
+
+      levels[top].dir.assign(path);
+      levels[top].depth = depth;
+      levels[top].remove = v.remove;
+
+      list(levels[top]);
+    }
+
+    // an index of a walk cut short would miss what was not walked
+
+    return !fresh || m_pool.cancelled() || fresh->commit();
+  }
+
+#endif
+
+  // with -sorted, how many bytes of listings may wait to be written, past
+  // which the walk spends itself on the next one to be
+
+  static constexpr std::size_t sorted_budget = 64 << 20;
+
+  // queue the job of l ahead of the others unless it is visited already
+
+  void expedite(listing& l) {
+    if (l.claimed.load(std::memory_order_acquire) || l.expedited.exchange(true, std::memory_order_relaxed))
+      return;
+
+    l.refs.fetch_add(1, std::memory_order_relaxed);
+
+    m_pool.expedite({ l.node, &l, l.lane });
+  }
+
+  // write out the listings that are ready, depth first, releasing each once
+  // written. Whoever completes a listing calls this: one at a time does the
+  // writing, the others only leave it a request to look again, so that no
+  // thread ever waits for another. What was listed ahead of the output is
+  // bounded by sorted_budget.
+
+  void emit() {
+    if (m_emit_requests.fetch_add(1, std::memory_order_acq_rel) != 0)
+      return;
+
+    auto& out = m_output[m_pool.size()];
+
+    for (auto seen = std::size_t{ 1 };; ) {
+      while (!m_emit_stack.empty() && !(m_params.limit && m_limited == *m_params.limit) && !m_quit.load(std::memory_order_relaxed)) {
+        auto& f = m_emit_stack.back();
+
+        if (!f.l->ready.load(std::memory_order_acquire))
+          break;
+
+        if (f.item == f.l->items.size()) {
+          m_buffered.fetch_sub(f.l->size(), std::memory_order_relaxed);
+
+          listing::unref(f.l);
+
+          m_emit_stack.pop_back();
+
+          continue;
+        }
+
+        auto& it = f.l->items[f.item++];
+
+        auto text = f.l->text.substr(f.from, it.end - f.from);
+
+        // -limit cuts the output at the line it is reached at, all the
+        // lines of an entry having the same length
+
+        if (m_params.limit && it.prints > 0) {
+          auto left = *m_params.limit - m_limited;
+
+          if (it.prints >= left) {
+            out.append_entries(text.substr(0, text.size() / it.prints * left));
+
+            m_limited = *m_params.limit;
+
+            if (it.child)
+              m_emit_stack.push_back({ it.child, 0, 0 });
+
+            m_pool.cancel();
+
+            break;
+          }
+
+          m_limited += it.prints;
+        }
+
+        out.append_entries(text);
+
+        f.from = it.end;
+
+        // the first -quit in order ends the output, and the walk, right
+        // after its own lines
+
+        if (it.quit) {
+          m_quit.store(true, std::memory_order_relaxed);
+
+          m_pool.cancel();
+
+          break;
+        }
+
+        if (it.child)
+          m_emit_stack.push_back({ it.child, 0, 0 });
+      }
+
+      // past the budget the listing the output waits on is the only one
+      // worth filling in, the others would wait too: it is queued ahead of
+      // them and the pool hands out nothing else until the output catches
+      // up
+
+      auto over = m_buffered.load(std::memory_order_relaxed) > sorted_budget;
+
+      m_pool.hold(over);
+
+      if (over && !m_emit_stack.empty())
+        expedite(*m_emit_stack.back().l);
+
+      // requests that came meanwhile may be about listings just passed on
+
+      auto left = m_emit_requests.fetch_sub(seen, std::memory_order_acq_rel) - seen;
+
+      if (left == 0)
+        return;
+
+      seen = left;
+    }
+  }
+};
+
+}
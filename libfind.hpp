@@ -0,0 +1,235 @@
+﻿/*
+Copyright (c) 2025 Giuseppe Roberti.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "find.hpp"
+
+#include <generator>
+
+// the walk of find for a program to embed: instead of printing them, what
+// matches is handed to a visitor a directory buffer at a time, names as
+// views into what the directory was read in and metadata fetched only if
+// asked for, so that there is neither a process to spawn nor text to parse
+//
+//   libfind::walk({ "/srv", "-name", "*.log", "-j", "4" },
+//     [](std::string_view dir, std::span<const libfind::entry> entries) {
+//       for (auto& e : entries)
+//         index(dir, e.name, e.meta().size);
+//     });
+//
+// The visitor runs on the workers of the walk, concurrently for different
+// directories (-j 1 makes it serial), and the entries only live until it
+// returns. entries() pulls the same from a generator instead:
+//
+//   auto status = std::expected<void, libfind::error>{};
+//
+//   for (auto& e : libfind::entries({ "/srv", "-name", "*.log" }, &status))
+//     index(e.dir, e.name, e.meta().size);
+
+namespace libfind {
+
+using entry = detail::dir_entry;
+
+using meta = detail::file_meta;
+
+using meta_need = detail::meta_need;
+
+using visitor = detail::finder::visitor;
+
+using error = detail::error_code;
+
+// walk with args as find takes them, but for the name of the program:
+// the roots, then options and expression, whatever would print visited
+
+inline auto walk(std::span<const char* const> args, visitor fn)
+  -> std::expected<void, error>
+{
+  auto argv = std::vector<const char*>{ "find" };
+
+  argv.insert(argv.end(), args.begin(), args.end());
+
+  return detail::finder::from({ static_cast<int>(argv.size()), argv.data() })
+    .and_then([&](detail::finder&& f) { return f.walk(std::move(fn)); });
+}
+
+inline auto walk(std::initializer_list<const char*> args, visitor fn)
+  -> std::expected<void, error>
+{
+  return walk(std::span{ args.begin(), args.size() }, std::move(fn));
+}
+
+namespace detail {
+
+// a batch a worker has handed over to entries(), which it waits on until
+// it is gone through
+
+struct handover {
+  std::span<const entry> entries;
+  bool done = false;
+};
+
+// what walk() visits, pulled one entry at a time. The walk runs on a
+// thread of its own and every worker with a batch to hand over waits for
+// the consumer to be done with it, so that no more is buffered than one
+// batch per worker and a slow consumer pauses the walk, rather than the
+// matches piling up. Entries are the ones of the listing, valid until the
+// next one is pulled. Leaving the loop early stops the walk; status, if
+// given, has how it ended once the generator is done. The strings of args
+// are parsed once the first entry is pulled, they have to live until then.
+
+inline auto pull(std::vector<const char*> argv, std::expected<void, error>* status)
+  -> std::generator<const entry&>
+{
+  auto f = finder::from({ static_cast<int>(argv.size()), argv.data() });
+
+  if (!f) {
+    if (status)
+      *status = std::unexpected{ f.error() };
+
+    co_return;
+  }
+
+  struct channel {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<handover*> queued;
+    handover* current = nullptr;
+    bool stopped = false;
+    bool finished = false;
+  } ch;
+
+  auto result = std::expected<void, error>{};
+
+  auto walker = std::thread{ [&]() {
+    result = f->walk([&](std::string_view, std::span<const entry> batch) {
+      auto h = handover{ batch };
+
+      std::unique_lock lck{ ch.mtx };
+
+      if (ch.stopped)
+        return;
+
+      ch.queued.push_back(&h);
+
+      ch.cv.notify_all();
+
+      ch.cv.wait(lck, [&]() { return h.done; });
+    });
+
+    std::lock_guard guard{ ch.mtx };
+
+    ch.finished = true;
+
+    ch.cv.notify_all();
+  } };
+
+  // however the generator ends, and that includes being destroyed at a
+  // co_yield, the workers are let go and the walk is waited for
+
+  struct closer {
+    channel& ch;
+    finder& f;
+    std::thread& walker;
+
+    ~closer() {
+      {
+        std::lock_guard guard{ ch.mtx };
+
+        ch.stopped = true;
+
+        if (ch.current)
+          ch.current->done = true;
+
+        for (auto* h : ch.queued)
+          h->done = true;
+
+        ch.queued.clear();
+
+        ch.cv.notify_all();
+      }
+
+      f.stop();
+
+      walker.join();
+    }
+  };
+
+  {
+    auto close = closer{ ch, *f, walker };
+
+    while (true) {
+      {
+        std::unique_lock lck{ ch.mtx };
+
+        ch.cv.wait(lck, [&]() { return !ch.queued.empty() || ch.finished; });
+
+        if (ch.queued.empty())
+          break;
+
+        ch.current = ch.queued.front();
+
+        ch.queued.pop_front();
+      }
+
+      for (auto& e : ch.current->entries)
+        co_yield e;
+
+      std::lock_guard guard{ ch.mtx };
+
+      std::exchange(ch.current, nullptr)->done = true;
+
+      ch.cv.notify_all();
+    }
+  }
+
+  if (status)
+    *status = result;
+}
+
+}
+
+inline auto entries(std::span<const char* const> args, std::expected<void, error>* status = nullptr)
+  -> std::generator<const entry&>
+{
+  auto argv = std::vector<const char*>{ "find" };
+
+  argv.insert(argv.end(), args.begin(), args.end());
+
+  return detail::pull(std::move(argv), status);
+}
+
+inline auto entries(std::initializer_list<const char*> args, std::expected<void, error>* status = nullptr)
+  -> std::generator<const entry&>
+{
+  return entries(std::span{ args.begin(), args.size() }, status);
+}
+
+}